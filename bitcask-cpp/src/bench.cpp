@@ -0,0 +1,483 @@
+#include "bench.h"
+#include "data/hint_file.h"
+#include "db.h"
+#include "index/snapshot.h"
+#include "utils/RwLock.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <random>
+#include <set>
+#include <filesystem>
+#include <map>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+using namespace bitcask;
+
+namespace {
+
+vector< u8 > to_bytes( const string &str ) {
+    return vector< u8 >( str.begin(), str.end() );
+}
+
+// 执行 fn 并返回耗时，单位毫秒
+template < typename F > double elapsed_ms( F &&fn ) {
+    auto start = chrono::steady_clock::now();
+    fn();
+    chrono::duration< double, milli > elapsed =
+        chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// 对比读取 hint 文件与完整扫描数据文件、单线程与多线程重建索引时打开引擎的耗时
+void bench_open() {
+    constexpr u64 KEY_NUM    = 200000;
+    constexpr u64 VALUE_SIZE = 1024;
+
+    Options options;
+    options.dir_path       = "../../../../tmp/bench_open";
+    options.data_file_size = 16 * 1024 * 1024;
+    filesystem::remove_all( options.dir_path );
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        auto value  = vector< u8 >( VALUE_SIZE, 'v' );
+        for ( u64 i = 0; i < KEY_NUM; i++ ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ), value );
+        }
+    }
+
+    // 只统计打开的耗时，不包含关闭时补齐 hint 文件的时间
+    auto open_ms = [ & ]( u32 threads ) {
+        options.index_load_threads = threads;
+        shared_ptr< Engine > engine;
+        return elapsed_ms(
+            [ & ] { engine = Engine::open( options ).unwrap(); } );
+    };
+    auto remove_hint_files = [ & ]() {
+        for ( auto &entry :
+              filesystem::directory_iterator( options.dir_path ) ) {
+            if ( entry.path().extension() == HINT_FILE_NAME_SUFFIX ) {
+                filesystem::remove( entry.path() );
+            }
+        }
+    };
+
+    cout << "open " << KEY_NUM << " keys (" << VALUE_SIZE
+         << " bytes values)" << endl;
+    for ( u32 threads : { 1u, 0u } ) {
+        string name = threads == 1 ? "1 thread" : "all cores";
+        cout << "  with hint files, " << name << ": " << open_ms( threads )
+             << " ms" << endl;
+        remove_hint_files();
+        cout << "  without hint files, " << name << ": "
+             << open_ms( threads ) << " ms" << endl;
+    }
+
+    // 索引快照之后只需重放少量新写入的数据
+    {
+        auto engine = Engine::open( options ).unwrap();
+        engine->checkpoint().unwrap();
+        auto value = vector< u8 >( VALUE_SIZE, 'w' );
+        for ( u64 i = 0; i < KEY_NUM / 100; i++ ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ), value );
+        }
+    }
+    cout << "  with index snapshot (1% tail): " << open_ms( 0 ) << " ms"
+         << endl;
+
+    // 延迟加载索引: 打开之后立即可以读取，读取旧 key 时才加载对应的文件
+    remove_index_snapshot( options.dir_path );
+    options.lazy_index_load = true;
+    {
+        shared_ptr< Engine > engine;
+        double               open = elapsed_ms(
+            [ & ] { engine = Engine::open( options ).unwrap(); } );
+        auto   old_key   = to_bytes( "key-" + to_string( KEY_NUM / 2 ) );
+        double first_get = elapsed_ms( [ & ] { engine->get( old_key ); } );
+        double all_loaded = elapsed_ms( [ & ] { engine->list_keys(); } );
+        cout << "  lazy index load: open " << open << " ms, first get "
+             << first_get << " ms, rest loaded after " << all_loaded << " ms"
+             << endl;
+    }
+    options.lazy_index_load = false;
+
+    filesystem::remove_all( options.dir_path );
+}
+
+// 对比 merge 时通过 copy_file_range 与经过用户态缓冲区拷贝有效数据的吞吐量和 CPU 开销
+void bench_merge() {
+    constexpr u64 KEY_NUM    = 200000;
+    constexpr u64 VALUE_SIZE = 1024;
+
+    Options options;
+    options.dir_path            = "../../../../tmp/bench_merge";
+    options.data_file_size      = 16 * 1024 * 1024;
+    options.merge_garbage_ratio = 0;
+
+    auto data_files = [ & ]() {
+        set< string > files;
+        for ( auto &entry :
+              filesystem::directory_iterator( options.dir_path ) ) {
+            if ( entry.path().extension() == DATA_FILE_NAME_SUFFIX ) {
+                files.insert( entry.path().string() );
+            }
+        }
+        return files;
+    };
+
+    cout << "merge " << KEY_NUM << " keys (" << VALUE_SIZE
+         << " bytes values), first half overwritten" << endl;
+    for ( bool zero_copy : { true, false } ) {
+        filesystem::remove_all( options.dir_path );
+        options.merge_zero_copy = zero_copy;
+
+        {
+            auto engine = Engine::open( options ).unwrap();
+            auto value  = vector< u8 >( VALUE_SIZE, 'v' );
+            for ( u64 i = 0; i < KEY_NUM; i++ ) {
+                engine->put( to_bytes( "key-" + to_string( i ) ), value );
+            }
+            // 后一半 key 在旧数据文件中形成连续的有效记录
+            for ( u64 i = 0; i < KEY_NUM / 2; i++ ) {
+                engine->put( to_bytes( "key-" + to_string( i ) ), value );
+            }
+        }
+        // 重新打开，关闭时已经为所有旧数据文件生成了 hint 文件
+        auto engine = Engine::open( options ).unwrap();
+
+        auto    before = data_files();
+        clock_t cpu    = clock();
+        double  ms     = elapsed_ms( [ & ] { engine->merge().unwrap(); } );
+        double  cpu_ms = 1000.0 * ( clock() - cpu ) / CLOCKS_PER_SEC;
+
+        u64 copied = 0;
+        for ( const auto &file : data_files() ) {
+            if ( !before.count( file ) ) {
+                copied += filesystem::file_size( file );
+            }
+        }
+        double gb = static_cast< double >( copied ) / ( 1 << 30 );
+        cout << "  " << ( zero_copy ? "copy_file_range" : "buffered copy" )
+             << ": " << copied / ( 1 << 20 ) << " MiB in " << ms << " ms, "
+             << copied / ( 1 << 20 ) / ( ms / 1000 ) << " MiB/s, "
+             << cpu_ms / 1000 / gb << " CPU s/GiB" << endl;
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+// 生成 n 个服从 Zipf( s ) 分布的下标，下标越小访问越频繁
+vector< u64 > zipf_indexes( u64 key_num, double s, u64 n, u64 seed ) {
+    vector< double > cdf( key_num );
+    double           sum = 0;
+    for ( u64 i = 0; i < key_num; i++ ) {
+        sum      += 1.0 / pow( static_cast< double >( i + 1 ), s );
+        cdf[ i ]  = sum;
+    }
+
+    mt19937_64                          rng( seed );
+    uniform_real_distribution< double > dist( 0, sum );
+    vector< u64 >                       indexes( n );
+    for ( auto &index : indexes ) {
+        auto iter = lower_bound( cdf.begin(), cdf.end(), dist( rng ) );
+        index     = min< u64 >( iter - cdf.begin(), key_num - 1 );
+    }
+    return indexes;
+}
+
+// Zipf 分布的随机读取下，对比不开启与开启 value 缓存时的吞吐量和命中率
+void bench_value_cache() {
+    constexpr u64 KEY_NUM         = 200000;
+    constexpr u64 VALUE_SIZE      = 1024;
+    constexpr u64 THREAD_NUM      = 4;
+    constexpr u64 GETS_PER_THREAD = 500000;
+
+    Options options;
+    options.dir_path       = "../../../../tmp/bench_value_cache";
+    options.data_file_size = 16 * 1024 * 1024;
+    filesystem::remove_all( options.dir_path );
+
+    vector< vector< u8 > > keys;
+    {
+        auto engine = Engine::open( options ).unwrap();
+        auto value  = vector< u8 >( VALUE_SIZE, 'v' );
+        for ( u64 i = 0; i < KEY_NUM; i++ ) {
+            keys.push_back( to_bytes( "key-" + to_string( i ) ) );
+            engine->put( keys.back(), value );
+        }
+    }
+
+    // 随机打乱 key 与 Zipf 下标的对应关系，热点 key 分散在各个数据文件中
+    shuffle( keys.begin(), keys.end(), mt19937_64( 42 ) );
+    vector< vector< u64 > > workloads;
+    for ( u64 t = 0; t < THREAD_NUM; t++ ) {
+        workloads.push_back(
+            zipf_indexes( KEY_NUM, 0.99, GETS_PER_THREAD, t ) );
+    }
+
+    cout << "zipf(0.99) get on " << KEY_NUM << " keys (" << VALUE_SIZE
+         << " bytes values), " << THREAD_NUM << " threads" << endl;
+    for ( u64 cache_bytes : { u64( 0 ), KEY_NUM * VALUE_SIZE / 10 } ) {
+        options.value_cache_bytes = cache_bytes;
+        auto engine               = Engine::open( options ).unwrap();
+
+        double ms = elapsed_ms( [ & ] {
+            vector< thread > threads;
+            for ( u64 t = 0; t < THREAD_NUM; t++ ) {
+                threads.emplace_back( [ &, t ]() {
+                    for ( u64 index : workloads[ t ] ) {
+                        engine->get( keys[ index ] ).unwrap();
+                    }
+                } );
+            }
+            for ( auto &t : threads ) {
+                t.join();
+            }
+        } );
+
+        auto   stats = engine->cache_stats();
+        double ops   = THREAD_NUM * GETS_PER_THREAD / ( ms / 1000 );
+        cout << "  cache " << cache_bytes / ( 1 << 20 ) << " MiB: " << ops
+             << " ops/s";
+        if ( cache_bytes > 0 ) {
+            cout << ", hit ratio "
+                 << 100.0 * stats.hits / ( stats.hits + stats.misses ) << "%";
+        }
+        cout << endl;
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+// 对比逐个 get 与 multi_get 读取一批随机 key 的吞吐量
+void bench_multi_get() {
+    constexpr u64 KEY_NUM    = 200000;
+    constexpr u64 VALUE_SIZE = 256;
+    constexpr u64 BATCH_NUM  = 2000;
+
+    Options options;
+    options.dir_path       = "../../../../tmp/bench_multi_get";
+    options.data_file_size = 16 * 1024 * 1024;
+    filesystem::remove_all( options.dir_path );
+
+    auto engine = Engine::open( options ).unwrap();
+    auto value  = vector< u8 >( VALUE_SIZE, 'v' );
+    for ( u64 i = 0; i < KEY_NUM; i++ ) {
+        engine->put( to_bytes( "key-" + to_string( i ) ), value );
+    }
+
+    mt19937_64 rng( 42 );
+    cout << "multi_get random keys from " << KEY_NUM << " keys (" << VALUE_SIZE
+         << " bytes values)" << endl;
+    for ( u64 batch_size : { 50, 500 } ) {
+        vector< vector< vector< u8 > > > batches( BATCH_NUM );
+        for ( auto &batch : batches ) {
+            for ( u64 i = 0; i < batch_size; i++ ) {
+                auto key = "key-" + to_string( rng() % KEY_NUM );
+                batch.push_back( to_bytes( key ) );
+            }
+        }
+
+        double get_ms = elapsed_ms( [ & ] {
+            for ( const auto &batch : batches ) {
+                for ( const auto &key : batch ) {
+                    engine->get( key ).unwrap();
+                }
+            }
+        } );
+        double multi_get_ms = elapsed_ms( [ & ] {
+            for ( const auto &batch : batches ) {
+                engine->multi_get( batch );
+            }
+        } );
+        double keys = static_cast< double >( BATCH_NUM * batch_size );
+        cout << "  batch " << batch_size << ": get " << keys / get_ms * 1000
+             << " keys/s, multi_get " << keys / multi_get_ms * 1000
+             << " keys/s" << endl;
+    }
+
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
+}
+
+// 对比逐个 get 与带预读的 scan 按顺序遍历所有数据的吞吐量
+void bench_scan() {
+    constexpr u64 KEY_NUM    = 200000;
+    constexpr u64 VALUE_SIZE = 256;
+
+    Options options;
+    options.dir_path       = "../../../../tmp/bench_scan";
+    options.data_file_size = 16 * 1024 * 1024;
+    filesystem::remove_all( options.dir_path );
+
+    auto engine = Engine::open( options ).unwrap();
+    auto value  = vector< u8 >( VALUE_SIZE, 'v' );
+    // 随机顺序写入，按 key 遍历时读取的位置是随机的
+    vector< u64 > ids( KEY_NUM );
+    for ( u64 i = 0; i < KEY_NUM; i++ ) {
+        ids[ i ] = i;
+    }
+    shuffle( ids.begin(), ids.end(), mt19937_64( 42 ) );
+    for ( u64 id : ids ) {
+        engine->put( to_bytes( "key-" + to_string( id ) ), value );
+    }
+
+    double get_ms = elapsed_ms( [ & ] {
+        for ( const auto &key : engine->list_keys() ) {
+            engine->get( key ).unwrap();
+        }
+    } );
+    u64    count   = 0;
+    double scan_ms = elapsed_ms( [ & ] {
+        engine->scan( IteratorOptions(),
+                      [ & ]( const vector< u8 > &, const vector< u8 > & ) {
+                          count++;
+                          return true;
+                      } );
+    } );
+    cout << "scan " << count << " keys (" << VALUE_SIZE
+         << " bytes values): get " << KEY_NUM / get_ms * 1000
+         << " keys/s, scan " << KEY_NUM / scan_ms * 1000 << " keys/s" << endl;
+
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
+}
+
+// 对比客户端 get + put 与引擎内的 increment 并发自增计数器的吞吐量，
+// get + put 之间没有互斥，会丢失并发的更新
+void bench_read_modify_write() {
+    constexpr u64 COUNTER_NUM    = 1000;
+    constexpr u64 THREAD_NUM     = 4;
+    constexpr u64 OPS_PER_THREAD = 100000;
+
+    Options options;
+    options.dir_path       = "../../../../tmp/bench_read_modify_write";
+    options.data_file_size = 16 * 1024 * 1024;
+    filesystem::remove_all( options.dir_path );
+
+    vector< vector< u8 > > keys;
+    for ( u64 i = 0; i < COUNTER_NUM; i++ ) {
+        keys.push_back( to_bytes( "counter-" + to_string( i ) ) );
+    }
+
+    // 每种方式都从新的数据库开始，避免受到之前写入的数据文件的影响
+    shared_ptr< Engine > engine;
+    auto                 run = [ & ]( auto &&increment ) {
+        engine.reset();
+        filesystem::remove_all( options.dir_path );
+        engine = Engine::open( options ).unwrap();
+        for ( const auto &key : keys ) {
+            engine->put( key, to_bytes( "0" ) );
+        }
+        double ms = elapsed_ms( [ & ] {
+            vector< thread > threads;
+            for ( u64 t = 0; t < THREAD_NUM; t++ ) {
+                threads.emplace_back( [ &, t ]() {
+                    mt19937_64 rng( t );
+                    for ( u64 i = 0; i < OPS_PER_THREAD; i++ ) {
+                        increment( keys[ rng() % COUNTER_NUM ] );
+                    }
+                } );
+            }
+            for ( auto &t : threads ) {
+                t.join();
+            }
+        } );
+        u64 total = 0;
+        for ( const auto &key : keys ) {
+            auto value = engine->get( key ).unwrap();
+            total += stoull( string( value.begin(), value.end() ) );
+        }
+        return make_pair( THREAD_NUM * OPS_PER_THREAD / ( ms / 1000 ),
+                          THREAD_NUM * OPS_PER_THREAD - total );
+    };
+
+    auto [ get_put_ops, get_put_lost ] = run( [ & ]( const vector< u8 > &key ) {
+        auto value = engine->get( key ).unwrap();
+        auto text  = to_string( stoll( string( value.begin(), value.end() ) ) +
+                                1 );
+        engine->put( key, to_bytes( text ) );
+    } );
+    auto [ increment_ops, increment_lost ] = run(
+        [ & ]( const vector< u8 > &key ) { engine->increment( key, 1 ); } );
+    cout << "increment " << COUNTER_NUM << " counters, " << THREAD_NUM
+         << " threads: get + put " << get_put_ops << " ops/s (" << get_put_lost
+         << " updates lost), increment " << increment_ops << " ops/s ("
+         << increment_lost << " updates lost)" << endl;
+
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
+}
+
+// 读多写少的并发访问一个有序表的吞吐量，临界区为一次查找，写者修改一个表项
+template < typename Mutex >
+double rwlock_ops( u64 thread_num, u64 write_percent ) {
+    constexpr u64 ENTRY_NUM = 1024;
+    constexpr u64 TOTAL_OPS = 1000000;
+
+    Mutex           mutex;
+    map< u64, u64 > table;
+    for ( u64 i = 0; i < ENTRY_NUM; i++ ) {
+        table[ i ] = i;
+    }
+    atomic< u64 > sink = 0;
+    double        ms   = elapsed_ms( [ & ] {
+        vector< thread > threads;
+        for ( u64 t = 0; t < thread_num; t++ ) {
+            threads.emplace_back( [ &, t ]() {
+                mt19937_64 rng( t );
+                u64        sum = 0;
+                for ( u64 i = 0; i < TOTAL_OPS / thread_num; i++ ) {
+                    u64 key = rng() % ENTRY_NUM;
+                    if ( rng() % 100 < write_percent ) {
+                        unique_lock< Mutex > lock( mutex );
+                        table[ key ]++;
+                    } else {
+                        shared_lock< Mutex > lock( mutex );
+                        sum += table.find( key )->second;
+                    }
+                }
+                sink += sum;
+            } );
+        }
+        for ( auto &t : threads ) {
+            t.join();
+        }
+    } );
+    return TOTAL_OPS / ( ms / 1000 );
+}
+
+// 对比 std::shared_mutex 与 ScalableSharedMutex 在 1 ~ 64 个线程下的吞吐量
+void bench_rwlock() {
+    for ( u64 write_percent : { 0, 1, 10 } ) {
+        for ( u64 thread_num : { 1, 2, 4, 8, 16, 32, 64 } ) {
+            double std_ops = rwlock_ops< shared_mutex >( thread_num,
+                                                         write_percent );
+            double scalable_ops =
+                rwlock_ops< ScalableSharedMutex >( thread_num, write_percent );
+            cout << "rwlock " << thread_num << " threads, " << write_percent
+                 << "% writes: std::shared_mutex " << std_ops
+                 << " ops/s, ScalableSharedMutex " << scalable_ops << " ops/s"
+                 << endl;
+        }
+    }
+}
+
+} // namespace
+
+void bench() {
+    bench_open();
+    bench_merge();
+    bench_value_cache();
+    bench_multi_get();
+    bench_scan();
+    bench_read_modify_write();
+    bench_rwlock();
+}
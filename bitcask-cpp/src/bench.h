@@ -0,0 +1,10 @@
+#pragma once
+
+#include "utils/type.h"
+
+#include <iostream>
+using namespace std;
+using namespace bitcask;
+
+// 性能测试入口，通过 `bitcask-cpp bench` 运行
+void bench();
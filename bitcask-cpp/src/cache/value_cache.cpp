@@ -0,0 +1,244 @@
+#include "value_cache.h"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace bitcask {
+
+namespace {
+
+// 每个缓存项除 value 之外的内存开销估计: 哈希表节点、CLOCK 槽位等
+constexpr u64 CACHE_ENTRY_OVERHEAD = 64;
+
+// 估计频率时 value 的平均大小，用来决定 sketch 的宽度
+constexpr u64 SKETCH_BYTES_PER_COUNTER = 256;
+constexpr u64 SKETCH_MIN_WIDTH         = 1024;
+constexpr u64 SKETCH_MAX_WIDTH         = 1 << 20;
+
+// 计数器的上限，与 4 位计数器相同
+constexpr u8 SKETCH_MAX_COUNT = 15;
+
+// 位置的哈希值，用于选择分片和 sketch 的计数器 (splitmix64)
+u64 pos_hash( const LogRecordPos &pos ) {
+    u64 x = ( static_cast< u64 >( pos.file_id ) << 40 ) ^ pos.offset;
+    x += 0x9e3779b97f4a7c15ull;
+    x  = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+    x  = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebull;
+    return x ^ ( x >> 31 );
+}
+
+// count-min sketch，估计每个位置最近的访问频率。
+// 累计增加 10 倍宽度次之后所有计数器减半，旧的热点数据逐渐冷却
+class FrequencySketch {
+  public:
+    explicit FrequencySketch( u64 width )
+        : mask( width - 1 )
+        , sample_size( width * 10 )
+        , table( width * DEPTH, 0 ) {
+    }
+
+    void increment( u64 hash ) {
+        bool added = false;
+        for ( u64 i = 0; i < DEPTH; i++ ) {
+            u8 &counter = table[ index_of( hash, i ) ];
+            if ( counter < SKETCH_MAX_COUNT ) {
+                counter++;
+                added = true;
+            }
+        }
+        if ( added && ++additions >= sample_size ) {
+            reset();
+        }
+    }
+
+    u8 frequency( u64 hash ) const {
+        u8 freq = SKETCH_MAX_COUNT;
+        for ( u64 i = 0; i < DEPTH; i++ ) {
+            freq = min( freq, table[ index_of( hash, i ) ] );
+        }
+        return freq;
+    }
+
+  private:
+    static constexpr u64 DEPTH = 4;
+
+    u64 index_of( u64 hash, u64 row ) const {
+        u64 h = ( hash + row * 0x9e3779b97f4a7c15ull ) * 0xff51afd7ed558ccdull;
+        return row * ( mask + 1 ) + ( ( h >> 32 ) & mask );
+    }
+
+    void reset() {
+        for ( auto &counter : table ) {
+            counter >>= 1;
+        }
+        additions /= 2;
+    }
+
+    u64          mask;
+    u64          sample_size;
+    u64          additions = 0;
+    vector< u8 > table;
+};
+
+u64 sketch_width( u64 capacity ) {
+    u64 target = clamp( capacity / SKETCH_BYTES_PER_COUNTER, SKETCH_MIN_WIDTH,
+                        SKETCH_MAX_WIDTH );
+    u64 width  = 1;
+    while ( width < target ) {
+        width <<= 1;
+    }
+    return width;
+}
+
+} // namespace
+
+// 一个缓存分片: 哈希表 + CLOCK 环 + 频率估计，全部由 mutex 保护
+class ValueCache::Shard {
+  public:
+    explicit Shard( u64 capacity )
+        : capacity( capacity )
+        , sketch( sketch_width( capacity ) ) {
+    }
+
+    optional< vector< u8 > > get( const LogRecordPos &pos, u64 hash ) {
+        lock_guard< mutex > lock( mtx );
+        sketch.increment( hash );
+        auto iter = slots.find( hash );
+        if ( iter == slots.end() ) {
+            return nullopt;
+        }
+        auto &entry = entries[ iter->second ];
+        if ( entry.file_id != pos.file_id || entry.offset != pos.offset ) {
+            return nullopt;
+        }
+        entry.referenced = true;
+        return entry.value;
+    }
+
+    void put( const LogRecordPos &pos, u64 hash, const vector< u8 > &value ) {
+        u64 charge = value.size() + CACHE_ENTRY_OVERHEAD;
+        if ( charge > capacity ) {
+            return;
+        }
+
+        lock_guard< mutex > lock( mtx );
+        if ( slots.count( hash ) != 0 ) {
+            return;
+        }
+
+        // 空间不足时由 CLOCK 选出淘汰者，新数据的频率更高时才替换它，
+        // 否则拒绝缓存新数据
+        u8 freq = sketch.frequency( hash );
+        while ( used + charge > capacity ) {
+            u64 victim = next_victim();
+            if ( sketch.frequency( entries[ victim ].hash ) >= freq ) {
+                return;
+            }
+            evict( victim );
+        }
+
+        u64 idx;
+        if ( !free_slots.empty() ) {
+            idx = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            idx = entries.size();
+            entries.emplace_back();
+        }
+        auto &entry      = entries[ idx ];
+        entry.file_id    = pos.file_id;
+        entry.offset     = pos.offset;
+        entry.hash       = hash;
+        entry.value      = value;
+        entry.referenced = false;
+        entry.in_use     = true;
+        slots.emplace( hash, idx );
+        used += charge;
+    }
+
+    u64 bytes() const {
+        lock_guard< mutex > lock( mtx );
+        return used;
+    }
+
+  private:
+    struct Entry {
+        u32          file_id    = 0;
+        u64          offset     = 0;
+        u64          hash       = 0;
+        vector< u8 > value;
+        bool         referenced = false;
+        bool         in_use     = false;
+    };
+
+    // CLOCK 指针转动，清除访问位，返回第一个未被访问过的缓存项。
+    // 调用方保证至少有一个缓存项
+    u64 next_victim() {
+        while ( true ) {
+            if ( hand >= entries.size() ) {
+                hand = 0;
+            }
+            auto &entry = entries[ hand ];
+            if ( entry.in_use && !entry.referenced ) {
+                return hand++;
+            }
+            entry.referenced = false;
+            hand++;
+        }
+    }
+
+    void evict( u64 idx ) {
+        auto &entry = entries[ idx ];
+        slots.erase( entry.hash );
+        used -= entry.value.size() + CACHE_ENTRY_OVERHEAD;
+        entry.value.clear();
+        entry.value.shrink_to_fit();
+        entry.in_use = false;
+        free_slots.push_back( idx );
+    }
+
+    u64                       capacity;
+    u64                       used = 0;
+    mutable mutex             mtx;
+    FrequencySketch           sketch;
+    vector< Entry >           entries;
+    vector< u64 >             free_slots;
+    unordered_map< u64, u64 > slots;
+    u64                       hand = 0;
+};
+
+ValueCache::ValueCache( u64 capacity_bytes ) {
+    for ( auto &shard : shards ) {
+        shard = make_unique< Shard >( capacity_bytes / SHARD_NUM );
+    }
+}
+
+ValueCache::~ValueCache() = default;
+
+optional< vector< u8 > > ValueCache::get( const LogRecordPos &pos ) {
+    u64  hash  = pos_hash( pos );
+    auto value = shards[ hash % SHARD_NUM ]->get( pos, hash );
+    if ( value.has_value() ) {
+        hits.fetch_add( 1, memory_order_relaxed );
+    } else {
+        misses.fetch_add( 1, memory_order_relaxed );
+    }
+    return value;
+}
+
+void ValueCache::put( const LogRecordPos &pos, const vector< u8 > &value ) {
+    u64 hash = pos_hash( pos );
+    shards[ hash % SHARD_NUM ]->put( pos, hash, value );
+}
+
+CacheStats ValueCache::stats() const {
+    CacheStats stats;
+    stats.hits   = hits.load( memory_order_relaxed );
+    stats.misses = misses.load( memory_order_relaxed );
+    for ( auto &shard : shards ) {
+        stats.bytes += shard->bytes();
+    }
+    return stats;
+}
+
+} // namespace bitcask
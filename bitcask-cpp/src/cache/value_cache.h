@@ -0,0 +1,54 @@
+#pragma once
+#include "../data/log_record.h"
+#include "../utils/nocopyable.h"
+#include "../utils/type.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+using namespace std;
+
+namespace bitcask {
+
+// value 缓存的命中统计
+struct CacheStats {
+    u64 hits   = 0;
+    u64 misses = 0;
+    // 当前缓存占用的字节数
+    u64 bytes = 0;
+};
+
+// 以 LogRecordPos 为 key 的 value 缓存，位于 DataFile 的读取之前。
+//
+// 同一个位置上的记录写入之后不会再改变，key 被覆盖、删除或者被 merge 移动之后
+// 索引指向新的位置，旧的缓存项不会再被访问，随淘汰自然失效，不需要显式删除。
+//
+// 按位置哈希分成多个分片，每个分片有独立的锁和字节预算。分片内使用 CLOCK
+// 淘汰，并用 TinyLFU 决定是否准入: 新数据的访问频率 (由 count-min sketch 估计)
+// 不高于被淘汰的数据时不缓存，一次性的扫描不会冲掉热点数据。
+class ValueCache : public Nocopyable {
+  public:
+    // capacity_bytes 为所有分片的字节预算之和
+    explicit ValueCache( u64 capacity_bytes );
+    ~ValueCache();
+
+    // 命中时返回 value 的拷贝
+    optional< vector< u8 > > get( const LogRecordPos &pos );
+
+    // 从数据文件读取之后放入缓存，可能因为准入策略而被拒绝
+    void put( const LogRecordPos &pos, const vector< u8 > &value );
+
+    CacheStats stats() const;
+
+  private:
+    class Shard;
+
+    static constexpr u64 SHARD_NUM = 16;
+
+    array< unique_ptr< Shard >, SHARD_NUM > shards;
+    atomic< u64 >                           hits   = 0;
+    atomic< u64 >                           misses = 0;
+};
+
+} // namespace bitcask
@@ -0,0 +1,105 @@
+#include "db.h"
+#include "index/snapshot.h"
+#include <filesystem>
+
+namespace bitcask {
+
+// 索引快照需要与各数据文件中的位置完全一致: 持有全部 key 锁之后，
+// 所有进行中的写入都已经发布并更新了索引，之后的写入都会分配更大的序列号。
+// merge 写入的记录保留原有的序列号，不能作为快照之后的增量重放，
+// 因此 checkpoint 与 merge 互斥，merge 开始时删除已有的快照，
+// 成功之后再重新生成。
+Result< bool, Errors > Engine::checkpoint() {
+    if ( auto res = wait_index_loaded(); res.is_err() ) {
+        return res;
+    }
+    lock_guard< mutex > merge_lock( merge_mutex );
+    return write_checkpoint();
+}
+
+Result< bool, Errors > Engine::write_checkpoint() {
+    IndexSnapshot snapshot;
+    {
+        vector< unique_lock< mutex > > locks;
+        locks.reserve( KEY_LOCK_NUM );
+        for ( auto &key_lock : key_locks ) {
+            locks.emplace_back( key_lock );
+        }
+
+        snapshot.seq_no = seq_no.load();
+        auto add_file   = [ & ]( const DataFile &data_file ) {
+            snapshot.files.push_back( SnapshotFileInfo{
+                data_file.get_file_id(), data_file.get_readable_off(),
+                data_file.get_dead_bytes(), data_file.get_min_seq_no(),
+                data_file.get_slot_num() } );
+        };
+        for ( const auto &slot : active_files ) {
+            add_file( *slot->data_file.load() );
+        }
+        for ( const auto &[ file_id, data_file ] : *older_files.load() ) {
+            add_file( *data_file );
+        }
+        snapshot.entries = index->list_entries();
+    }
+
+    // 快照覆盖的数据必须先落盘，崩溃之后快照才不会引用丢失的记录
+    if ( auto res = sync(); res.is_err() ) {
+        return res;
+    }
+    return write_index_snapshot( options.dir_path, snapshot );
+}
+
+unordered_map< u32, SnapshotFileInfo > Engine::load_index_snapshot() {
+    unordered_map< u32, SnapshotFileInfo > files;
+
+    auto res = read_index_snapshot( options.dir_path );
+    if ( res.is_err() ) {
+        return files;
+    }
+    auto snapshot = res.unwrap();
+
+    // 快照中的数据文件必须全部存在且不短于快照覆盖的位置，否则快照已经失效
+    for ( const auto &file : snapshot.files ) {
+        error_code ec;
+        auto       size = filesystem::file_size(
+            DataFile::get_data_file_name( options.dir_path, file.file_id ),
+            ec );
+        if ( ec || size < file.watermark ||
+             find_data_file( file.file_id ) == nullptr ) {
+            return files;
+        }
+    }
+
+    // 快照之前的记录中，只有索引引用的记录仍然有效，据此恢复失效位图
+    unordered_map< u32, vector< u64 > > dead_maps;
+    for ( const auto &file : snapshot.files ) {
+        auto &dead_map = dead_maps[ file.file_id ];
+        dead_map.assign( ( file.slot_num + 63 ) / 64, ~0ull );
+        if ( file.slot_num % 64 != 0 ) {
+            dead_map.back() = ( 1ull << ( file.slot_num % 64 ) ) - 1;
+        }
+    }
+    for ( const auto &[ key, pos ] : snapshot.entries ) {
+        if ( pos.expire_at != 0 ) {
+            track_expiry( key, pos.expire_at );
+        }
+        if ( auto iter = dead_maps.find( pos.file_id );
+             iter != dead_maps.end() && pos.slot / 64 < iter->second.size() ) {
+            iter->second[ pos.slot / 64 ] &= ~( 1ull << ( pos.slot % 64 ) );
+        }
+    }
+
+    for ( const auto &file : snapshot.files ) {
+        auto data_file = find_data_file( file.file_id );
+        data_file->set_dead_bytes( file.dead_bytes );
+        data_file->observe_seq_no( file.min_seq_no );
+        data_file->set_slot_num( file.slot_num );
+        data_file->set_dead_map( std::move( dead_maps[ file.file_id ] ) );
+        files.emplace( file.file_id, file );
+    }
+    index->bulk_load( std::move( snapshot.entries ) );
+    seq_no = snapshot.seq_no;
+    return files;
+}
+
+} // namespace bitcask
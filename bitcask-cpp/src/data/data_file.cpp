@@ -0,0 +1,236 @@
+#include "data_file.h"
+#include "../utils/crc32.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+namespace bitcask {
+
+namespace {
+
+// 从内存中解码一条长度为 len 的完整记录并校验 crc
+Result< LogRecord, Errors > decode_log_record( const u8 *buf, u64 len ) {
+    auto header =
+        LogRecordHeader::decode( buf, min( len, MAX_LOG_RECORD_HEADER_SIZE ) );
+    if ( !header.has_value() ||
+         header->header_size + header->key_size + header->value_size != len ) {
+        return Err( Errors::ReadDataFileEOF );
+    }
+    if ( crc32( buf + 4, len - 4 ) != header->crc ) {
+        return Err( Errors::InvalidLogRecordCrc );
+    }
+
+    const u8 *key = buf + header->header_size;
+    LogRecord record;
+    record.rec_type  = header->rec_type;
+    record.seq_no    = header->seq_no;
+    record.expire_at = header->expire_at;
+    record.in_batch  = header->in_batch;
+    record.key.assign( key, key + header->key_size );
+    record.value.assign( key + header->key_size, buf + len );
+    return Ok( std::move( record ) );
+}
+
+} // namespace
+
+DataFile::DataFile( const string &dir_path, u32 file_id )
+    : file_id( file_id )
+    , write_off( 0 )
+    , readable_off( 0 )
+    , io_manager( make_unique< FileIO >(
+          get_data_file_name( dir_path, file_id ) ) ) {
+}
+
+string DataFile::get_data_file_name( const string &dir_path, u32 file_id ) {
+    // 文件名为 9 位的文件 id，不足补 0，例如 000000001.data
+    char name[ 16 ];
+    snprintf( name, sizeof( name ), "%09u", file_id );
+    return ( filesystem::path( dir_path ) /
+             ( string( name ) + string( DATA_FILE_NAME_SUFFIX ) ) )
+        .string();
+}
+
+Result< ReadLogRecord, Errors >
+DataFile::read_log_record( u64 offset, optional< u64 > limit,
+                           bool verify_crc ) {
+    // 刚打开的文件在加载索引之前 write_off 为 0，以文件的长度为界
+    u64 end = limit.value_or( io_manager->size() );
+    try {
+        // 先读取最大长度的头部信息，文件末尾可能不足
+        vector< u8 > header_buf( MAX_LOG_RECORD_HEADER_SIZE );
+        u64          header_len = io_manager->read( header_buf, offset );
+
+        auto header = LogRecordHeader::decode( header_buf, header_len );
+        // 读到文件末尾或者遇到空记录，说明已经读完
+        if ( !header.has_value() ||
+             ( header->key_size == 0 && header->value_size == 0 ) ) {
+            return Err( Errors::ReadDataFileEOF );
+        }
+
+        // 读取实际的 key 和 value。写了一半或者损坏的记录中的长度可能是
+        // 任意值，超出 end 时不再分配缓冲区
+        u64 kv_size = static_cast< u64 >( header->key_size ) +
+                      header->value_size;
+        if ( offset + header->header_size + kv_size > end ) {
+            return Err( Errors::ReadDataFileEOF );
+        }
+        vector< u8 > kv_buf( kv_size );
+        if ( io_manager->read( kv_buf, offset + header->header_size ) !=
+             kv_size ) {
+            return Err( Errors::ReadDataFileEOF );
+        }
+
+        // 校验 crc，覆盖头部中 crc 之后的部分以及 key、value
+        if ( verify_crc ) {
+            u32 crc = crc32( header_buf.data() + 4, header->header_size - 4 );
+            crc     = crc32_update( crc, kv_buf.data(), kv_buf.size() );
+            if ( crc != header->crc ) {
+                return Err( Errors::InvalidLogRecordCrc );
+            }
+        }
+
+        LogRecord record;
+        record.rec_type  = header->rec_type;
+        record.seq_no    = header->seq_no;
+        record.expire_at = header->expire_at;
+        record.in_batch  = header->in_batch;
+        record.key.assign( kv_buf.begin(),
+                           kv_buf.begin() + header->key_size );
+        record.value.assign( kv_buf.begin() + header->key_size,
+                             kv_buf.end() );
+        return Ok( ReadLogRecord{ std::move( record ),
+                                  header->header_size + kv_size } );
+    } catch ( const runtime_error & ) {
+        return Err( Errors::FailedToReadFromDataFile );
+    }
+}
+
+vector< Result< LogRecord, Errors > >
+DataFile::read_log_records( const vector< LogRecordPos > &run ) {
+    vector< Result< LogRecord, Errors > > records;
+    records.reserve( run.size() );
+    if ( run.empty() ) {
+        return records;
+    }
+
+    u64 start = run.front().offset;
+    u64 end   = start;
+    for ( const auto &pos : run ) {
+        end = max( end, pos.offset + pos.size );
+    }
+
+    optional< Errors > err;
+    vector< u8 >       buf( end - start );
+    try {
+        if ( io_manager->read( buf, start ) != buf.size() ) {
+            err = Errors::ReadDataFileEOF;
+        }
+    } catch ( const runtime_error & ) {
+        err = Errors::FailedToReadFromDataFile;
+    }
+
+    for ( const auto &pos : run ) {
+        if ( err.has_value() ) {
+            records.push_back( Err( *err ) );
+        } else {
+            const u8 *data = buf.data() + pos.offset - start;
+            records.push_back( decode_log_record( data, pos.size ) );
+        }
+    }
+    return records;
+}
+
+Result< u64, Errors > DataFile::write_at( vector< u8 > &buf, u64 offset ) {
+    try {
+        return Ok( io_manager->write_at( buf, offset ) );
+    } catch ( const runtime_error & ) {
+        return Err( Errors::FailedToWriteToDataFile );
+    }
+}
+
+Result< u64, Errors > DataFile::write( vector< u8 > &buf ) {
+    u64  offset = reserve( buf.size() );
+    auto res    = write_at( buf, offset );
+    // 写入失败也需要发布该区域，否则之后的写者会一直等待
+    publish( offset, buf.size() );
+    return res;
+}
+
+Result< bool, Errors > DataFile::sync() {
+    try {
+        io_manager->sync();
+        return Ok( true );
+    } catch ( const runtime_error & ) {
+        return Err( Errors::FailedToSyncDataFile );
+    }
+}
+
+Result< u64, Errors > DataFile::copy_from( DataFile &src, u64 src_offset,
+                                           u64 len, bool zero_copy ) {
+    u64  offset = reserve( len );
+    u64  copied = 0;
+    bool failed = false;
+    try {
+        copied = io_manager->copy_from( *src.io_manager, src_offset, len,
+                                        offset, zero_copy );
+    } catch ( const runtime_error & ) {
+        failed = true;
+    }
+    publish( offset, len );
+    if ( failed || copied != len ) {
+        return Err( Errors::FailedToWriteToDataFile );
+    }
+    return Ok( offset );
+}
+
+void DataFile::disable_live_map() {
+    lock_guard< mutex > lock( live_map_mutex );
+    live_map_enabled = false;
+    dead_map         = {};
+}
+
+bool DataFile::has_live_map() const {
+    return live_map_enabled.load( memory_order_acquire );
+}
+
+void DataFile::mark_dead( u32 slot ) {
+    // 停用之后不会再开启，不需要加锁
+    if ( !live_map_enabled.load( memory_order_acquire ) ) {
+        return;
+    }
+    lock_guard< mutex > lock( live_map_mutex );
+    if ( !live_map_enabled ) {
+        return;
+    }
+    if ( slot / 64 >= dead_map.size() ) {
+        dead_map.resize( max< u64 >( slot / 64 + 1, dead_map.size() * 2 ) );
+    }
+    dead_map[ slot / 64 ] |= 1ull << ( slot % 64 );
+}
+
+void DataFile::set_dead_map( vector< u64 > map ) {
+    lock_guard< mutex > lock( live_map_mutex );
+    if ( live_map_enabled ) {
+        dead_map = std::move( map );
+    }
+}
+
+optional< vector< u64 > > DataFile::get_dead_map() const {
+    lock_guard< mutex > lock( live_map_mutex );
+    if ( !live_map_enabled ) {
+        return nullopt;
+    }
+    return dead_map;
+}
+
+Result< bool, Errors > DataFile::truncate( u64 size ) {
+    try {
+        io_manager->truncate( size );
+    } catch ( const runtime_error & ) {
+        return Err( Errors::FailedToWriteToDataFile );
+    }
+    set_write_off( size );
+    return sync();
+}
+
+} // namespace bitcask
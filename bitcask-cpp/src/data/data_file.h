@@ -1,44 +1,216 @@
 #pragma once
+#include "../errors.h"
 #include "../fio/file_io.h"
 #include "../utils/IOManager.h"
+#include "../utils/Result.h"
 #include "../utils/type.h"
 #include "./log_record.h"
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
 #include <vector>
 using namespace std;
 
 namespace bitcask {
 
+// 数据文件的扩展名
+constexpr string_view DATA_FILE_NAME_SUFFIX = ".data";
+
 // IOManager 抽象 IO 管理对象，可以介入不同的 IO 类型。需要保证多线程传递安全。
+//
+// 写入分为三步: reserve 通过 fetch_add 预留出互不重叠的区域，多个写者随后可以
+// 并行地 write_at 拷贝数据，最后按照预留的顺序 publish，推进可读水位线。
+// 水位线之前的数据都已经完整写入，读者不会读到写了一半的记录。
 class DataFile {
   public:
-    // TODO:
-    DataFile( shared_ptr< u32 > file_id, shared_ptr< u64 > write_off,
-              unique_ptr< IOManager > io_manager )
+    DataFile( u32 file_id, u64 write_off, unique_ptr< IOManager > io_manager )
         : file_id( file_id )
         , write_off( write_off )
+        , readable_off( write_off )
         , io_manager( std::move( io_manager ) ) {
     }
+
+    // 打开 dir_path 目录下 id 为 file_id 的数据文件，不存在则创建
+    DataFile( const string &dir_path, u32 file_id );
+
+    // 已经预留出去的写偏移
     u64 get_write_off() const {
-        return *write_off;
+        return write_off.load( memory_order_acquire );
+    }
+
+    // 可读水位线，之前的数据都已经完整写入
+    u64 get_readable_off() const {
+        return readable_off.load( memory_order_acquire );
+    }
+
+    // 加载索引之后设置写偏移，此时还没有并发的写者
+    void set_write_off( u64 offset ) {
+        write_off.store( offset, memory_order_release );
+        readable_off.store( offset, memory_order_release );
     }
 
     u32 get_file_id() const {
-        return *file_id;
+        return file_id;
+    }
+
+    // 文件中记录的最小序列号，没有记录时为 UINT64_MAX
+    u64 get_min_seq_no() const {
+        return min_seq_no.load( memory_order_acquire );
+    }
+
+    // 写入或加载一条记录之后更新最小序列号
+    void observe_seq_no( u64 seq ) {
+        u64 current = min_seq_no.load( memory_order_relaxed );
+        while ( seq < current &&
+                !min_seq_no.compare_exchange_weak( current, seq ) ) {
+        }
+    }
+
+    // 文件中无效数据 (被覆盖、删除的记录以及墓碑值) 的字节数
+    u64 get_dead_bytes() const {
+        return dead_bytes.load( memory_order_relaxed );
+    }
+
+    void add_dead_bytes( u64 bytes ) {
+        dead_bytes.fetch_add( bytes, memory_order_relaxed );
+    }
+
+    void set_dead_bytes( u64 bytes ) {
+        dead_bytes.store( bytes, memory_order_relaxed );
+    }
+
+    // 为接下来追加的 n 条记录分配序号，调用方需要保证序号与写入偏移的顺序一致
+    u32 reserve_slots( u32 n ) {
+        return slot_num.fetch_add( n, memory_order_relaxed );
+    }
+
+    // 加载之后设置已有记录的数量，此时还没有并发的写者
+    void set_slot_num( u32 n ) {
+        slot_num.store( n, memory_order_relaxed );
+    }
+
+    // 已经分配的记录序号数量
+    u32 get_slot_num() const {
+        return slot_num.load( memory_order_relaxed );
+    }
+
+    // 加载时无法得知已有记录的序号时停用失效位图，merge 退回到查询索引
+    void disable_live_map();
+
+    bool has_live_map() const;
+
+    // 将序号为 slot 的记录标记为失效
+    void mark_dead( u32 slot );
+
+    // 加载时整体设置失效位图，例如从索引快照恢复
+    void set_dead_map( vector< u64 > map );
+
+    // 失效位图的拷贝，第 slot 位为 1 表示该记录已经失效。
+    // 停用时返回 nullopt
+    optional< vector< u64 > > get_dead_map() const;
+
+    // 位置信息对应的记录被覆盖或删除: 计入无效数据并标记失效
+    void add_dead( const LogRecordPos &pos ) {
+        add_dead_bytes( pos.size );
+        mark_dead( pos.slot );
+    }
+
+    // 无效数据占文件大小的比例
+    double get_garbage_ratio() const {
+        u64 size = get_write_off();
+        return size == 0 ? 0 : static_cast< double >( get_dead_bytes() ) / size;
+    }
+
+    // 根据 offset 从数据文件中读取 LogRecord，可以被多个线程并发调用。
+    // 记录超出 limit 时视为读到文件末尾，不会按损坏的长度分配缓冲区，
+    // 不指定时为文件的长度; 崩溃恢复时已经持久化的记录可以跳过 crc 校验
+    Result< ReadLogRecord, Errors >
+    read_log_record( u64 offset, optional< u64 > limit = nullopt,
+                     bool verify_crc = true );
+
+    // 一次读取 run 中按 offset 排好序的多条记录: 读取第一条记录的起点到最后一条
+    // 记录的终点之间的数据，再逐条解码并校验 crc，结果与 run 一一对应。
+    // 位置信息中的 size 必须是记录的实际长度
+    vector< Result< LogRecord, Errors > >
+    read_log_records( const vector< LogRecordPos > &run );
+
+    // 预留长度为 len 的写入区域，返回区域的起始偏移
+    u64 reserve( u64 len ) {
+        return write_off.fetch_add( len, memory_order_acq_rel );
+    }
+
+    // 将数据写入预留的区域，不同区域可以并行写入
+    Result< u64, Errors > write_at( vector< u8 > &buf, u64 offset );
+
+    // 发布 [offset, offset + len) 区域，需要等待之前预留的区域全部发布之后
+    // 才能推进水位线。on_publish 在轮到该区域时执行，用于按写入顺序更新索引。
+    template < typename F > void publish( u64 offset, u64 len, F &&on_publish ) {
+        while ( readable_off.load( memory_order_acquire ) != offset ) {
+            this_thread::yield();
+        }
+        on_publish();
+        readable_off.store( offset + len, memory_order_release );
     }
 
-    LogRecord read_log_record( u64 offset );
+    void publish( u64 offset, u64 len ) {
+        publish( offset, len, [] {} );
+    }
+
+    // 等待所有已预留的区域发布完成
+    void wait_published() const {
+        while ( get_readable_off() != get_write_off() ) {
+            this_thread::yield();
+        }
+    }
+
+    // 追加写入数据，等价于 reserve + write_at + publish
+    Result< u64, Errors > write( vector< u8 > &buf );
+
+    // 将 src 中 [src_offset, src_offset + len) 的数据原样追加到文件末尾，
+    // 返回写入的起始偏移。zero_copy 为 true 时优先在内核中拷贝
+    Result< u64, Errors > copy_from( DataFile &src, u64 src_offset, u64 len,
+                                     bool zero_copy = true );
+
+    Result< bool, Errors > sync();
+
+    // 截断到 size 并持久化，同时设置写偏移，此时还没有并发的读写者
+    Result< bool, Errors > truncate( u64 size );
+
+    // 获取数据文件的完整路径
+    static string get_data_file_name( const string &dir_path, u32 file_id );
 
   private:
-    // 数据文件的 ID，用于标识数据文件
-    shared_ptr< u32 > file_id;
+    // 数据文件的 ID，用于标识数据文件，创建之后不再修改
+    const u32 file_id;
+
+    // 当前写偏移，记录该数据文件预留到了哪个位置
+    atomic< u64 > write_off;
+
+    // 可读水位线，记录该数据文件完整写入到了哪个位置
+    atomic< u64 > readable_off;
+
+    // 文件中记录的最小序列号，merge 时判断墓碑值能否丢弃
+    atomic< u64 > min_seq_no = UINT64_MAX;
+
+    // 无效数据的字节数，merge 时据此挑选文件
+    atomic< u64 > dead_bytes = 0;
+
+    // 已经分配的记录序号数量
+    atomic< u32 > slot_num = 0;
 
-    // 当前写偏移，记录该数据文件写到了哪个位置
-    shared_ptr< u64 > write_off;
+    // 按记录序号标记已经失效的记录，merge 时据此跳过无效记录而不需要查询索引。
+    // 标记只发生在覆盖和删除时，与追加写入互不影响
+    mutable mutex  live_map_mutex;
+    vector< u64 >  dead_map;
+    atomic< bool > live_map_enabled = true;
 
     // IO 管理对象，通过多态的形式管理不同的 IO 类型。
     unique_ptr< IOManager > io_manager;
 };
 
-} // namespace bitcask
\ No newline at end of file
+} // namespace bitcask
@@ -0,0 +1,300 @@
+#include "hint_file.h"
+#include "../fio/file_io.h"
+#include "../utils/crc32.h"
+#include "../utils/varint.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+namespace bitcask {
+
+namespace {
+
+// 布隆过滤器每个 key 占用的位数，误判率约为 1%
+constexpr u64 KEY_SUMMARY_BITS_PER_KEY = 10;
+constexpr u32 KEY_SUMMARY_HASH_NUM     = 7;
+
+// 摘要会被持久化，需要与平台无关的哈希函数，这里使用 FNV-1a
+u64 key_hash( const vector< u8 > &key ) {
+    u64 hash = 14695981039346656037ull;
+    for ( u8 byte : key ) {
+        hash = ( hash ^ byte ) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// 先写入临时文件并持久化，再重命名为 path
+Result< bool, Errors > write_file_atomically( const string &path,
+                                              vector< u8 > &buf ) {
+    auto tmp_path = path + ".tmp";
+    try {
+        // 上次崩溃可能留下了不完整的临时文件
+        filesystem::remove( tmp_path );
+        FileIO file_io( tmp_path );
+        file_io.write( buf );
+        file_io.sync();
+    } catch ( const exception & ) {
+        return Err( Errors::FailedToWriteToDataFile );
+    }
+
+    error_code ec;
+    filesystem::rename( tmp_path, path, ec );
+    if ( ec ) {
+        return Err( Errors::FailedToWriteToDataFile );
+    }
+    return Ok( true );
+}
+
+Result< vector< u8 >, Errors > read_whole_file( const string &path ) {
+    vector< u8 > buf;
+    try {
+        buf.resize( filesystem::file_size( path ) );
+        FileIO file_io( path );
+        if ( file_io.read( buf, 0 ) != buf.size() ) {
+            return Err( Errors::FailedToReadFromDataFile );
+        }
+    } catch ( const exception & ) {
+        return Err( Errors::FailedToReadFromDataFile );
+    }
+    return Ok( std::move( buf ) );
+}
+
+} // namespace
+
+void HintRecord::encode( vector< u8 > &buf ) const {
+    // 预留 crc 的位置，最后再填充
+    u64 start = buf.size();
+    buf.resize( start + 4 );
+    u8 type = static_cast< u8 >( rec_type );
+    if ( pos.expire_at != 0 ) {
+        type |= LOG_RECORD_EXPIRE_FLAG;
+    }
+    if ( in_batch ) {
+        type |= LOG_RECORD_BATCH_FLAG;
+    }
+    buf.push_back( type );
+    put_varint( buf, seq_no );
+    if ( pos.expire_at != 0 ) {
+        put_varint( buf, pos.expire_at );
+    }
+    put_varint( buf, key.size() );
+    put_varint( buf, pos.offset );
+    put_varint( buf, pos.size );
+    buf.insert( buf.end(), key.begin(), key.end() );
+
+    u32 crc = crc32( buf.data() + start + 4, buf.size() - start - 4 );
+    for ( int i = 0; i < 4; i++ ) {
+        buf[ start + i ] = static_cast< u8 >( crc >> ( 8 * i ) );
+    }
+}
+
+KeySummary KeySummary::build( const vector< HintRecord > &records ) {
+    KeySummary summary;
+    summary.hash_num = KEY_SUMMARY_HASH_NUM;
+    u64 bit_num = max< u64 >( 64, records.size() * KEY_SUMMARY_BITS_PER_KEY );
+    summary.bits.resize( ( bit_num + 7 ) / 8 );
+    bit_num = summary.bits.size() * 8;
+
+    for ( const auto &record : records ) {
+        summary.max_seq_no = max( summary.max_seq_no, record.seq_no );
+
+        // 双重哈希: 由一个 64 位哈希值派生出 hash_num 个位置
+        u64 hash  = key_hash( record.key );
+        u64 delta = ( hash >> 32 ) | 1;
+        for ( u32 i = 0; i < summary.hash_num; i++ ) {
+            u64 bit = ( hash + i * delta ) % bit_num;
+            summary.bits[ bit / 8 ] |= static_cast< u8 >( 1 << ( bit % 8 ) );
+        }
+    }
+    return summary;
+}
+
+bool KeySummary::may_contain( const vector< u8 > &key ) const {
+    u64 bit_num = bits.size() * 8;
+    if ( bit_num == 0 ) {
+        return true;
+    }
+    u64 hash  = key_hash( key );
+    u64 delta = ( hash >> 32 ) | 1;
+    for ( u32 i = 0; i < hash_num; i++ ) {
+        u64 bit = ( hash + i * delta ) % bit_num;
+        if ( ( bits[ bit / 8 ] & ( 1 << ( bit % 8 ) ) ) == 0 ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KeySummary::encode( vector< u8 > &buf ) const {
+    u64 start = buf.size();
+    buf.resize( start + 4 );
+    for ( int i = 0; i < 8; i++ ) {
+        buf.push_back( static_cast< u8 >( max_seq_no >> ( 8 * i ) ) );
+    }
+    for ( int i = 0; i < 4; i++ ) {
+        buf.push_back( static_cast< u8 >( hash_num >> ( 8 * i ) ) );
+    }
+    buf.insert( buf.end(), bits.begin(), bits.end() );
+
+    u32 crc = crc32( buf.data() + start + 4, buf.size() - start - 4 );
+    for ( int i = 0; i < 4; i++ ) {
+        buf[ start + i ] = static_cast< u8 >( crc >> ( 8 * i ) );
+    }
+}
+
+string get_hint_file_name( const string &dir_path, u32 file_id ) {
+    // 与数据文件同名，例如 000000001.hint
+    char name[ 16 ];
+    snprintf( name, sizeof( name ), "%09u", file_id );
+    return ( filesystem::path( dir_path ) /
+             ( string( name ) + string( HINT_FILE_NAME_SUFFIX ) ) )
+        .string();
+}
+
+string get_key_summary_file_name( const string &dir_path, u32 file_id ) {
+    char name[ 16 ];
+    snprintf( name, sizeof( name ), "%09u", file_id );
+    return ( filesystem::path( dir_path ) /
+             ( string( name ) + string( KEY_SUMMARY_FILE_NAME_SUFFIX ) ) )
+        .string();
+}
+
+Result< vector< HintRecord >, Errors >
+build_hint_records( DataFile &data_file, u64 offset ) {
+    vector< HintRecord > records;
+    while ( true ) {
+        auto res = data_file.read_log_record( offset );
+        if ( res.is_err() ) {
+            if ( res.unwrap_err() == Errors::ReadDataFileEOF ) {
+                break;
+            }
+            return Err( res.unwrap_err() );
+        }
+        auto         read_record = res.unwrap();
+        LogRecordPos pos( data_file.get_file_id(), offset,
+                          static_cast< u32 >( read_record.size ),
+                          static_cast< u32 >( records.size() ) );
+        pos.expire_at = read_record.record.expire_at;
+        records.push_back( HintRecord{ std::move( read_record.record.key ),
+                                       read_record.record.rec_type,
+                                       read_record.record.seq_no, pos,
+                                       read_record.record.in_batch } );
+        offset += read_record.size;
+    }
+    return Ok( std::move( records ) );
+}
+
+Result< bool, Errors > write_hint_file( const string             &dir_path,
+                                        u32                       file_id,
+                                        const vector< HintRecord > &records ) {
+    // 先写 key 摘要，延迟加载时只使用 hint 文件和摘要都存在的数据文件
+    vector< u8 > buf;
+    KeySummary::build( records ).encode( buf );
+    auto res = write_file_atomically(
+        get_key_summary_file_name( dir_path, file_id ), buf );
+    if ( res.is_err() ) {
+        return res;
+    }
+
+    buf.clear();
+    for ( const auto &record : records ) {
+        record.encode( buf );
+    }
+    return write_file_atomically( get_hint_file_name( dir_path, file_id ),
+                                  buf );
+}
+
+Result< vector< HintRecord >, Errors > read_hint_file( const string &dir_path,
+                                                       u32 file_id ) {
+    auto read_res = read_whole_file( get_hint_file_name( dir_path, file_id ) );
+    if ( read_res.is_err() ) {
+        return Err( read_res.unwrap_err() );
+    }
+    auto buf = read_res.unwrap();
+
+    vector< HintRecord > records;
+    u64                  index = 0;
+    while ( index < buf.size() ) {
+        if ( buf.size() - index <= 5 ) {
+            return Err( Errors::HintFileCorrupted );
+        }
+        u64 start = index;
+        u32 crc   = 0;
+        for ( int i = 0; i < 4; i++ ) {
+            crc |= static_cast< u32 >( buf[ index + i ] ) << ( 8 * i );
+        }
+        u8   type     = buf[ index + 4 ];
+        auto rec_type = static_cast< LogRecordType >(
+            type & ~( LOG_RECORD_EXPIRE_FLAG | LOG_RECORD_BATCH_FLAG ) );
+        index += 5;
+
+        u64  seq_no = 0, expire_at = 0, key_size = 0, offset = 0, size = 0;
+        auto fields = ( type & LOG_RECORD_EXPIRE_FLAG ) != 0
+                          ? vector< u64 * >{ &seq_no, &expire_at, &key_size,
+                                             &offset, &size }
+                          : vector< u64 * >{ &seq_no, &key_size, &offset,
+                                             &size };
+        for ( u64 *field : fields ) {
+            u64 n =
+                get_varint( buf.data() + index, buf.size() - index, *field );
+            if ( n == 0 ) {
+                return Err( Errors::HintFileCorrupted );
+            }
+            index += n;
+        }
+        if ( buf.size() - index < key_size ) {
+            return Err( Errors::HintFileCorrupted );
+        }
+        index += key_size;
+        if ( crc32( buf.data() + start + 4, index - start - 4 ) != crc ) {
+            return Err( Errors::HintFileCorrupted );
+        }
+
+        LogRecordPos pos( file_id, offset, static_cast< u32 >( size ),
+                          static_cast< u32 >( records.size() ) );
+        pos.expire_at = expire_at;
+        records.push_back( HintRecord{
+            vector< u8 >( buf.begin() + index - key_size,
+                          buf.begin() + index ),
+            rec_type, seq_no, pos, ( type & LOG_RECORD_BATCH_FLAG ) != 0 } );
+    }
+    return Ok( std::move( records ) );
+}
+
+Result< KeySummary, Errors > read_key_summary( const string &dir_path,
+                                               u32           file_id ) {
+    auto read_res =
+        read_whole_file( get_key_summary_file_name( dir_path, file_id ) );
+    if ( read_res.is_err() ) {
+        return Err( read_res.unwrap_err() );
+    }
+    auto buf = read_res.unwrap();
+    if ( buf.size() < 16 ) {
+        return Err( Errors::HintFileCorrupted );
+    }
+
+    auto get_fixed = [ & ]( u64 index, u64 len ) {
+        u64 value = 0;
+        for ( u64 i = 0; i < len; i++ ) {
+            value |= static_cast< u64 >( buf[ index + i ] ) << ( 8 * i );
+        }
+        return value;
+    };
+    if ( crc32( buf.data() + 4, buf.size() - 4 ) != get_fixed( 0, 4 ) ) {
+        return Err( Errors::HintFileCorrupted );
+    }
+
+    KeySummary summary;
+    summary.max_seq_no = get_fixed( 4, 8 );
+    summary.hash_num   = static_cast< u32 >( get_fixed( 12, 4 ) );
+    summary.bits.assign( buf.begin() + 16, buf.end() );
+    return Ok( std::move( summary ) );
+}
+
+void remove_hint_file( const string &dir_path, u32 file_id ) {
+    error_code ec;
+    filesystem::remove( get_hint_file_name( dir_path, file_id ), ec );
+    filesystem::remove( get_key_summary_file_name( dir_path, file_id ), ec );
+}
+
+} // namespace bitcask
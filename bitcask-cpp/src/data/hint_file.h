@@ -0,0 +1,78 @@
+#pragma once
+#include "../errors.h"
+#include "../utils/Result.h"
+#include "../utils/type.h"
+#include "./data_file.h"
+#include "./log_record.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace bitcask {
+
+// hint 文件的扩展名
+constexpr string_view HINT_FILE_NAME_SUFFIX = ".hint";
+
+// key 摘要文件的扩展名
+constexpr string_view KEY_SUMMARY_FILE_NAME_SUFFIX = ".keys";
+
+// hint 文件中的一条记录，对应数据文件中的一条 LogRecord，但不包含 value。
+// 格式: | crc | type | seq no | expire at | key size | offset | size | key |
+// crc 校验 type 之后的全部内容，其余字段为 varint 编码。
+// 与 LogRecord 相同，只有带过期时间的记录才有 expire at 字段，
+// 批量写入的记录在 type 中带有 LOG_RECORD_BATCH_FLAG
+struct HintRecord {
+    vector< u8 >  key;
+    LogRecordType rec_type;
+    u64           seq_no;
+    LogRecordPos  pos;
+    bool          in_batch;
+
+    void encode( vector< u8 > &buf ) const;
+};
+
+// 数据文件中全部 key 的摘要 (布隆过滤器) 以及最大序列号，与 hint 文件一起生成。
+// 延迟加载索引时不需要读取 hint 文件就能判断 key 是否可能在该文件中。
+// 格式: | crc | max seq no | hash num | bits |，crc 之后的字段为定长小端编码
+struct KeySummary {
+    u64          max_seq_no = 0;
+    u32          hash_num   = 0;
+    vector< u8 > bits;
+
+    static KeySummary build( const vector< HintRecord > &records );
+
+    // 返回 false 时 key 一定不在文件中
+    bool may_contain( const vector< u8 > &key ) const;
+
+    void encode( vector< u8 > &buf ) const;
+};
+
+// 获取 hint 文件的完整路径
+string get_hint_file_name( const string &dir_path, u32 file_id );
+
+// 获取 key 摘要文件的完整路径
+string get_key_summary_file_name( const string &dir_path, u32 file_id );
+
+// 从 offset 开始扫描数据文件，为其中每一条记录生成 hint 记录。
+// 位置信息中的序号从 0 开始按顺序编号，从头扫描时与记录在文件中的序号一致
+Result< vector< HintRecord >, Errors >
+build_hint_records( DataFile &data_file, u64 offset = 0 );
+
+// 将 hint 记录写入数据文件对应的 hint 文件，并生成 key 摘要文件。
+// 先写临时文件再重命名，hint 文件存在即说明内容完整
+Result< bool, Errors > write_hint_file( const string             &dir_path,
+                                        u32                       file_id,
+                                        const vector< HintRecord > &records );
+
+// 读取 hint 文件中的全部记录，按顺序为位置信息编号，内容损坏时返回 HintFileCorrupted
+Result< vector< HintRecord >, Errors > read_hint_file( const string &dir_path,
+                                                       u32 file_id );
+
+// 读取数据文件对应的 key 摘要，内容损坏时返回 HintFileCorrupted
+Result< KeySummary, Errors > read_key_summary( const string &dir_path,
+                                               u32           file_id );
+
+// 删除数据文件对应的 hint 文件和 key 摘要文件
+void remove_hint_file( const string &dir_path, u32 file_id );
+
+} // namespace bitcask
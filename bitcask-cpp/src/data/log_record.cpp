@@ -1,2 +1,78 @@
 #include "log_record.h"
-namespace bitcask {}
\ No newline at end of file
+#include "../utils/crc32.h"
+
+namespace bitcask {
+
+vector< u8 > LogRecord::encode() {
+    vector< u8 > buf;
+    buf.reserve( MAX_LOG_RECORD_HEADER_SIZE + key.size() + value.size() );
+
+    // 预留 crc 的位置，最后再填充
+    buf.resize( 4 );
+    u8 type = static_cast< u8 >( rec_type );
+    if ( expire_at != 0 ) {
+        type |= LOG_RECORD_EXPIRE_FLAG;
+    }
+    if ( in_batch ) {
+        type |= LOG_RECORD_BATCH_FLAG;
+    }
+    buf.push_back( type );
+    put_varint( buf, seq_no );
+    if ( expire_at != 0 ) {
+        put_varint( buf, expire_at );
+    }
+    put_varint( buf, key.size() );
+    put_varint( buf, value.size() );
+    buf.insert( buf.end(), key.begin(), key.end() );
+    buf.insert( buf.end(), value.begin(), value.end() );
+
+    // crc 以小端序写入头部
+    u32 crc = crc32( buf.data() + 4, buf.size() - 4 );
+    for ( int i = 0; i < 4; i++ ) {
+        buf[ i ] = static_cast< u8 >( crc >> ( 8 * i ) );
+    }
+    return buf;
+}
+
+optional< LogRecordHeader > LogRecordHeader::decode( const vector< u8 > &buf,
+                                                     u64                 len ) {
+    return decode( buf.data(), len );
+}
+
+optional< LogRecordHeader > LogRecordHeader::decode( const u8 *buf, u64 len ) {
+    if ( len <= 5 ) {
+        return nullopt;
+    }
+
+    LogRecordHeader header;
+    header.crc = 0;
+    for ( int i = 0; i < 4; i++ ) {
+        header.crc |= static_cast< u32 >( buf[ i ] ) << ( 8 * i );
+    }
+    header.rec_type  = static_cast< LogRecordType >(
+        buf[ 4 ] & ~( LOG_RECORD_EXPIRE_FLAG | LOG_RECORD_BATCH_FLAG ) );
+    header.in_batch  = ( buf[ 4 ] & LOG_RECORD_BATCH_FLAG ) != 0;
+    header.expire_at = 0;
+
+    u64 key_size   = 0;
+    u64 value_size = 0;
+    u64 index      = 5;
+    auto read_field = [ & ]( u64 &field ) {
+        u64 n = get_varint( buf + index, len - index, field );
+        index += n;
+        return n != 0;
+    };
+    if ( !read_field( header.seq_no ) ||
+         ( ( buf[ 4 ] & LOG_RECORD_EXPIRE_FLAG ) != 0 &&
+           !read_field( header.expire_at ) ) ||
+         !read_field( key_size ) || !read_field( value_size ) ) {
+        return nullopt;
+    }
+
+    header.key_size    = static_cast< u32 >( key_size );
+    header.value_size  = static_cast< u32 >( value_size );
+    header.header_size = index;
+    return header;
+}
+
+} // namespace bitcask
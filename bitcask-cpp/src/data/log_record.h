@@ -1,7 +1,9 @@
 #pragma once
 #include "../utils/type.h"
+#include "../utils/varint.h"
 #include <cstdint>
 #include <iostream>
+#include <optional>
 #include <vector>
 using namespace std;
 
@@ -12,16 +14,30 @@ enum LogRecordType {
     NORMAL = 1,
     // 被删除的数据标识，墓碑值
     DELETED = 2,
+    // 批量写入的提交标识，value 为该批量写入的记录数量 (varint)
+    TXNFINISHED = 3,
 };
 
+// 记录类型字节的最高位，置位时头部在序列号之后带有过期时间
+constexpr u8 LOG_RECORD_EXPIRE_FLAG = 0x80;
+
+// 记录类型字节的次高位，置位时记录属于一个批量写入，
+// 只有之后紧跟着完整的提交标识时才生效
+constexpr u8 LOG_RECORD_BATCH_FLAG = 0x40;
+
 // 数据位置索引信息，描述数据存储到了那个位置
 class LogRecordPos {
   public:
-    LogRecordPos( u32 fid, u64 oset )
+    LogRecordPos( u32 fid, u64 oset, u32 sz = 0, u32 sl = 0 )
         : file_id( fid )
-        , offset( oset ){};
-    u32 file_id; // 文件 id
-    u64 offset;  // 文件偏移量
+        , offset( oset )
+        , size( sz )
+        , slot( sl ){};
+    u32 file_id;       // 文件 id
+    u64 offset;        // 文件偏移量
+    u32 size;          // 记录在文件中的长度，被覆盖或删除时计入无效数据
+    u32 slot;          // 记录在文件中的序号，占用 size 之后的填充字节
+    u64 expire_at = 0; // 记录的过期时间 (unix 毫秒)，为 0 时永不过期
 
     // 重载==符号
     bool operator==( const LogRecordPos &p ) const {
@@ -32,13 +48,54 @@ class LogRecordPos {
     }
 };
 
+// crc 类型 u32 + 记录类型 u8 + 序列号与过期时间 varint +
+// key 与 value 的长度 varint
+constexpr u64 MAX_LOG_RECORD_HEADER_SIZE =
+    4 + 1 + MAX_VARINT64_LEN * 2 + MAX_VARINT32_LEN * 2;
+
+// LogRecord 写入数据文件的记录
+// 格式: | crc | type | seq no | expire at | key size | value size |
+//       | key | value |
+// crc 校验 type 之后的全部内容，其余字段为 varint 编码。
+// 只有 type 带有 LOG_RECORD_EXPIRE_FLAG 时才有 expire at 字段，
+// 不过期的记录与之前的格式相同
 class LogRecord {
   public:
     vector< u8 >  key;
     vector< u8 >  value;
     LogRecordType rec_type;
+    // 全局单调递增的序列号，多个活跃文件时用于判断同一个 key 的新旧
+    u64 seq_no = 0;
+    // 过期时间 (unix 毫秒)，为 0 时永不过期
+    u64 expire_at = 0;
+    // 是否属于一个批量写入
+    bool in_batch = false;
 
     vector< u8 > encode();
 };
 
+// LogRecord 的头部信息
+struct LogRecordHeader {
+    u32           crc;
+    LogRecordType rec_type;
+    u64           seq_no;
+    u64           expire_at;
+    u32           key_size;
+    u32           value_size;
+    bool          in_batch;
+    // 头部编码后的实际长度
+    u64 header_size;
+
+    // 从 buf 中解析头部，数据不足或为空记录时返回 nullopt
+    static optional< LogRecordHeader > decode( const vector< u8 > &buf,
+                                               u64                 len );
+    static optional< LogRecordHeader > decode( const u8 *buf, u64 len );
+};
+
+// 从数据文件中读取的 LogRecord 信息，包含其 size
+struct ReadLogRecord {
+    LogRecord record;
+    u64       size;
+};
+
 } // namespace bitcask
\ No newline at end of file
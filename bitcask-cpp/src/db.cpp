@@ -0,0 +1,1485 @@
+#include "db.h"
+#include "data/hint_file.h"
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+namespace bitcask {
+
+namespace {
+
+// 校验配置项是否合法
+optional< Errors > check_options( const Options &options ) {
+    if ( options.dir_path.empty() ) {
+        return Errors::DirPathIsEmpty;
+    }
+    if ( options.data_file_size == 0 ) {
+        return Errors::DataFileSizeIsInvalid;
+    }
+    if ( options.active_file_num == 0 ) {
+        return Errors::ActiveFileNumIsInvalid;
+    }
+    if ( options.merge_garbage_ratio < 0 || options.merge_garbage_ratio > 1 ) {
+        return Errors::MergeGarbageRatioIsInvalid;
+    }
+    if ( options.inline_value_size > InlineValue::MAX_SIZE ) {
+        return Errors::InlineValueSizeIsInvalid;
+    }
+    if ( options.ttl_tick_ms == 0 ) {
+        return Errors::TtlTickIsInvalid;
+    }
+    return nullopt;
+}
+
+unique_ptr< Indexer > new_indexer( IndexType index_type ) {
+    switch ( index_type ) {
+    case IndexType::BTree:
+        return make_unique< BTree >();
+    }
+    return make_unique< BTree >();
+}
+
+// 单个数据文件的解码结果，同一个 key 在文件内只保留序列号最大的记录
+struct LoadedDataFile {
+    vector< HintRecord > records;
+    // 数据文件的有效长度
+    u64 write_off = 0;
+    // 文件内被之后的记录覆盖的记录长度
+    u64 dead_bytes = 0;
+    u64 max_seq_no = 0;
+    // 是否从 hint 文件中读取
+    bool from_hint = false;
+};
+
+// 崩溃恢复: durable_off 之前的数据在上次 sync 时已经持久化，只解析不校验 crc;
+// 之后的尾部逐条校验，遇到写了一半或者损坏的记录时，截断该记录及之后的内容。
+// 批量写入一次追加到同一段区域，尾部没有提交标识的批量写入同样截断。
+// 恢复的耗时只与未持久化的尾部长度成正比
+Result< vector< HintRecord >, Errors >
+recover_data_file( const string &dir_path, DataFile &data_file, u64 offset,
+                   u64 durable_off ) {
+    u32        file_id = data_file.get_file_id();
+    error_code ec;
+    u64        file_size = filesystem::file_size(
+        DataFile::get_data_file_name( dir_path, file_id ), ec );
+    if ( ec ) {
+        return Err( Errors::FailedToReadFromDataFile );
+    }
+
+    vector< HintRecord > records;
+    // 是否有尚未看到提交标识的批量写入，以及它在文件中的起始位置和
+    // 之前的记录数量
+    bool in_open_batch = false;
+    u64  batch_off     = 0;
+    u64  batch_begin   = 0;
+    while ( offset < file_size ) {
+        auto res = data_file.read_log_record( offset, file_size,
+                                              offset >= durable_off );
+        if ( res.is_err() ) {
+            if ( res.unwrap_err() == Errors::ReadDataFileEOF ||
+                 res.unwrap_err() == Errors::InvalidLogRecordCrc ) {
+                break;
+            }
+            return Err( res.unwrap_err() );
+        }
+        auto  read_record = res.unwrap();
+        auto &record      = read_record.record;
+        if ( record.in_batch && !in_open_batch ) {
+            in_open_batch = true;
+            batch_off     = offset;
+            batch_begin   = records.size();
+        } else if ( record.rec_type == LogRecordType::TXNFINISHED ) {
+            // 提交标识中的记录数量与之前的批量记录一致时才算提交
+            u64 batch_num = 0;
+            if ( !in_open_batch ||
+                 get_varint( record.value.data(), record.value.size(),
+                             batch_num ) == 0 ||
+                 batch_num != records.size() - batch_begin ) {
+                break;
+            }
+            in_open_batch = false;
+        } else if ( !record.in_batch && in_open_batch ) {
+            break;
+        }
+
+        LogRecordPos pos( file_id, offset,
+                          static_cast< u32 >( read_record.size ),
+                          static_cast< u32 >( records.size() ) );
+        pos.expire_at = record.expire_at;
+        records.push_back( HintRecord{ std::move( record.key ),
+                                       record.rec_type, record.seq_no, pos,
+                                       record.in_batch } );
+        offset += read_record.size;
+    }
+    if ( in_open_batch ) {
+        records.erase( records.begin() + batch_begin, records.end() );
+        offset = batch_off;
+    }
+
+    if ( offset < file_size ) {
+        if ( auto res = data_file.truncate( offset ); res.is_err() ) {
+            return Err( res.unwrap_err() );
+        }
+    }
+    return Ok( std::move( records ) );
+}
+
+// 解码数据文件中 start 之后的全部记录，可以在多个线程中并发调用。
+// durable_off 有值时说明文件在崩溃前可能正在被写入，按 recover_data_file 恢复
+Result< LoadedDataFile, Errors >
+load_data_file( const string &dir_path, DataFile &data_file, bool is_older,
+                u64 start, optional< u64 > durable_off = nullopt ) {
+    LoadedDataFile loaded;
+    u32            file_id = data_file.get_file_id();
+    loaded.write_off       = start;
+
+    // 完整读取的旧数据文件优先读取 hint 文件，不需要读取 value。
+    // hint 文件损坏时退回到读取数据文件
+    vector< HintRecord > records;
+    if ( is_older && start == 0 &&
+         filesystem::exists( get_hint_file_name( dir_path, file_id ) ) ) {
+        auto res = read_hint_file( dir_path, file_id );
+        if ( res.is_ok() ) {
+            records          = res.unwrap();
+            loaded.from_hint = true;
+        }
+    }
+    if ( !loaded.from_hint ) {
+        auto res = durable_off.has_value()
+                       ? recover_data_file( dir_path, data_file, start,
+                                            *durable_off )
+                       : build_hint_records( data_file, start );
+        if ( res.is_err() ) {
+            return Err( res.unwrap_err() );
+        }
+        records = res.unwrap();
+    }
+
+    // 从索引快照覆盖的位置继续读取时，记录接着快照中已经分配的序号编号
+    u32 first_slot = data_file.get_slot_num();
+    for ( auto &record : records ) {
+        record.pos.slot += first_slot;
+    }
+
+    // 文件内先去重，减少合并到全局索引时的工作量
+    unordered_map< string_view, u64 > latest;
+    for ( u64 i = 0; i < records.size(); i++ ) {
+        const auto &record = records[ i ];
+        data_file.observe_seq_no( record.seq_no );
+        loaded.max_seq_no = max( loaded.max_seq_no, record.seq_no );
+        loaded.write_off  = record.pos.offset + record.pos.size;
+
+        // 提交标识本身是无效数据，不进入索引
+        if ( record.rec_type == LogRecordType::TXNFINISHED ) {
+            loaded.dead_bytes += record.pos.size;
+            data_file.mark_dead( record.pos.slot );
+            continue;
+        }
+
+        string_view key( reinterpret_cast< const char * >( record.key.data() ),
+                         record.key.size() );
+        auto [ iter, inserted ] = latest.try_emplace( key, i );
+        if ( inserted ) {
+            continue;
+        }
+        auto &prev = records[ iter->second ];
+        if ( record.seq_no >= prev.seq_no ) {
+            loaded.dead_bytes += prev.pos.size;
+            data_file.mark_dead( prev.pos.slot );
+            iter->second = i;
+        } else {
+            loaded.dead_bytes += record.pos.size;
+            data_file.mark_dead( record.pos.slot );
+        }
+    }
+
+    // 之后的写入继续编号
+    data_file.set_slot_num( first_slot + static_cast< u32 >( records.size() ) );
+
+    vector< u64 > kept;
+    kept.reserve( latest.size() );
+    for ( const auto &[ key, i ] : latest ) {
+        kept.push_back( i );
+    }
+    sort( kept.begin(), kept.end() );
+    loaded.records.reserve( kept.size() );
+    for ( u64 i : kept ) {
+        loaded.records.push_back( std::move( records[ i ] ) );
+    }
+    return Ok( std::move( loaded ) );
+}
+
+// 延迟加载索引时每次持有 lazy_mutex 合并的记录数，避免长时间阻塞前台写入
+constexpr u64 LAZY_LOAD_BATCH_SIZE = 1024;
+
+// multi_get 时同一个文件中间隔不超过该值的记录合并为一次读取，
+// 多读一小段数据比多一次系统调用更便宜
+constexpr u64 MULTI_GET_COALESCE_GAP = 4 * 1024;
+
+// multi_get 合并之后单次读取的最大长度
+constexpr u64 MULTI_GET_MAX_RUN_BYTES = 256 * 1024;
+
+// multi_get 每个线程至少负责的读取次数以及最多使用的线程数
+constexpr u64 MULTI_GET_RUNS_PER_THREAD = 16;
+constexpr u64 MULTI_GET_MAX_THREADS     = 8;
+
+} // namespace
+
+Engine::Engine( const Options &options )
+    : options( options )
+    , older_files( make_shared< const DataFileMap >() )
+    , index( new_indexer( options.index_type ) )
+    , merge_limiter( options.merge_bytes_per_sec )
+    , clock_ms( system_clock_ms() )
+    , ttl_wheel( clock_ms / options.ttl_tick_ms ) {
+    for ( u32 i = 0; i < options.active_file_num; i++ ) {
+        active_files.push_back( make_unique< ActiveFile >() );
+    }
+    if ( options.value_cache_bytes > 0 ) {
+        value_cache = make_unique< ValueCache >( options.value_cache_bytes );
+    }
+}
+
+Result< shared_ptr< Engine >, Errors > Engine::open( const Options &options ) {
+    // 校验配置项是否合法
+    if ( auto err = check_options( options ); err.has_value() ) {
+        return Err( *err );
+    }
+
+    // 判断目录是否存在，如果不存在则创建这个目录
+    error_code ec;
+    if ( !filesystem::is_directory( options.dir_path, ec ) ) {
+        if ( !filesystem::create_directories( options.dir_path, ec ) ) {
+            return Err( Errors::FailedToCreateDatabaseDir );
+        }
+    }
+
+    shared_ptr< Engine > engine( new Engine( options ) );
+
+    // 加载数据文件
+    if ( auto res = engine->load_data_files(); res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+
+    // 从数据文件中加载索引
+    if ( auto res = engine->load_index_from_data_files(); res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+
+    engine->opened = true;
+
+    // 启动后台线程
+    engine->background_thread = thread( [ raw = engine.get() ]() {
+        raw->background_loop();
+    } );
+    if ( !engine->index_loaded ) {
+        engine->lazy_load_thread = thread( [ raw = engine.get() ]() {
+            raw->lazy_load_loop();
+        } );
+    }
+
+    return Ok( engine );
+}
+
+Engine::~Engine() {
+    {
+        lock_guard< mutex > lock( ttl_mutex );
+        ttl_stop = true;
+    }
+    ttl_cv.notify_all();
+    if ( ttl_thread.joinable() ) {
+        ttl_thread.join();
+    }
+    if ( lazy_load_thread.joinable() ) {
+        lazy_load_stop = true;
+        lazy_load_thread.join();
+    }
+    if ( background_thread.joinable() ) {
+        {
+            lock_guard< mutex > lock( background_mutex );
+            background_stop = true;
+        }
+        background_cv.notify_all();
+        background_thread.join();
+    }
+    if ( opened ) {
+        sync();
+    }
+}
+
+Result< bool, Errors > Engine::put( const vector< u8 > &key,
+                                    const vector< u8 > &value, u64 ttl_ms ) {
+    // 判断 key 的有效性
+    if ( key.empty() ) {
+        return Err( Errors::KeyIsEmpty );
+    }
+
+    // 构造 LogRecord
+    LogRecord record{ key, value, LogRecordType::NORMAL };
+    if ( ttl_ms != 0 ) {
+        record.expire_at = system_clock_ms() + ttl_ms;
+    }
+
+    // 同一个 key 的写入串行化，并发写同一个 key 时索引总是指向最新的数据
+    lock_guard< mutex > lock( key_lock( key ) );
+    return write_record( record );
+}
+
+Result< bool, Errors > Engine::write_record( LogRecord &record ) {
+    // 追加写入活跃文件，并在发布时更新索引
+    auto res = append_log_record( record, [ & ]( const LogRecordPos &pos ) {
+        auto old_pos = index_put( record.key, pos, record.seq_no,
+                                  should_inline( record.value )
+                                      ? InlineValue( record.value )
+                                      : InlineValue() );
+        if ( old_pos.has_value() ) {
+            add_dead_bytes( *old_pos );
+        }
+        return true;
+    } );
+    if ( res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+    if ( record.expire_at != 0 ) {
+        track_expiry( record.key, record.expire_at );
+    }
+    return Ok( true );
+}
+
+Result< vector< u8 >, Errors > Engine::get( const vector< u8 > &key ) {
+    // 判断 key 的有效性
+    if ( key.empty() ) {
+        return Err( Errors::KeyIsEmpty );
+    }
+
+    // 延迟加载索引期间，先加载可能包含该 key 更新记录的旧数据文件
+    if ( !index_loaded.load( memory_order_acquire ) ) {
+        if ( auto res = load_lazy_files_for( key ); res.is_err() ) {
+            return Err( res.unwrap_err() );
+        }
+    }
+
+    // 从内存索引中获取 key 对应的位置信息
+    auto                     entry = index->get_entry( key );
+    optional< LogRecordPos > pos;
+    shared_ptr< DataFile >   data_file;
+    for ( int retry = 0; retry < 3; retry++ ) {
+        // 已经过期但回收线程尚未写入墓碑值的 key
+        if ( !entry.has_value() || is_expired( entry->pos ) ) {
+            return Err( Errors::KeyNotFound );
+        }
+
+        // 内联在索引中的小 value 不需要读取数据文件
+        if ( entry->value.has_value() ) {
+            return Ok( entry->value.value() );
+        }
+        pos = entry->pos;
+
+        // 位置上的记录不会再改变，命中缓存时不需要读取数据文件
+        if ( value_cache != nullptr ) {
+            if ( auto value = value_cache->get( *pos ); value.has_value() ) {
+                return Ok( std::move( *value ) );
+            }
+        }
+
+        // 只持有目标数据文件的引用，不阻塞写者和其他读者
+        data_file = find_data_file( pos->file_id );
+        if ( data_file != nullptr ) {
+            break;
+        }
+
+        // 数据文件刚刚被 merge 替换，索引已经指向新的位置，重新查询
+        entry = index->get_entry( key );
+    }
+    if ( data_file == nullptr ) {
+        return Err( Errors::DataFileNotFound );
+    }
+
+    auto res = data_file->read_log_record( pos->offset );
+    if ( res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+
+    // 判断 LogRecord 的类型
+    auto log_record = res.unwrap().record;
+    if ( log_record.rec_type == LogRecordType::DELETED ) {
+        return Err( Errors::KeyNotFound );
+    }
+
+    remember_value( key, *pos, log_record.value );
+    return Ok( std::move( log_record.value ) );
+}
+
+vector< Result< vector< u8 >, Errors > >
+Engine::multi_get( const vector< vector< u8 > > &keys ) {
+    // 延迟加载索引期间需要先加载可能包含各个 key 的旧数据文件，逐个读取
+    if ( !index_loaded.load( memory_order_acquire ) ) {
+        vector< Result< vector< u8 >, Errors > > values;
+        values.reserve( keys.size() );
+        for ( const auto &key : keys ) {
+            values.push_back( get( key ) );
+        }
+        return values;
+    }
+
+    // 一次查询所有 key 的索引
+    auto entries = index->multi_get( keys );
+    return read_values( keys, entries );
+}
+
+vector< Result< vector< u8 >, Errors > >
+Engine::read_values( const vector< vector< u8 > >           &keys,
+                     const vector< optional< IndexEntry > > &entries,
+                     const DataFileMap                      *data_files ) {
+    // 内联或者命中缓存的 value 直接返回
+    vector< optional< Result< vector< u8 >, Errors > > > results( keys.size() );
+    vector< pair< LogRecordPos, u64 > >                  reads;
+    for ( u64 i = 0; i < keys.size(); i++ ) {
+        const auto &entry = entries[ i ];
+        if ( keys[ i ].empty() ) {
+            results[ i ] = Err( Errors::KeyIsEmpty );
+            continue;
+        }
+        if ( !entry.has_value() || is_expired( entry->pos ) ) {
+            results[ i ] = Err( Errors::KeyNotFound );
+            continue;
+        }
+        if ( entry->value.has_value() ) {
+            results[ i ] = Ok( entry->value.value() );
+            continue;
+        }
+        optional< vector< u8 > > value;
+        if ( value_cache != nullptr ) {
+            value = value_cache->get( entry->pos );
+        }
+        if ( value.has_value() ) {
+            results[ i ] = Ok( std::move( *value ) );
+        } else {
+            reads.emplace_back( entry->pos, i );
+        }
+    }
+
+    // 按 (文件 id, 偏移) 排序，同一个文件中相距不远的记录合并为一次读取
+    sort( reads.begin(), reads.end(), []( const auto &a, const auto &b ) {
+        return make_pair( a.first.file_id, a.first.offset ) <
+               make_pair( b.first.file_id, b.first.offset );
+    } );
+    struct ReadRun {
+        u32                    file_id;
+        u64                    end;
+        vector< LogRecordPos > positions;
+        vector< u64 >          indexes;
+    };
+    vector< ReadRun > runs;
+    for ( auto &[ pos, i ] : reads ) {
+        u64 end = pos.offset + pos.size;
+        if ( runs.empty() || runs.back().file_id != pos.file_id ||
+             pos.offset > runs.back().end + MULTI_GET_COALESCE_GAP ||
+             end - runs.back().positions.front().offset >
+                 MULTI_GET_MAX_RUN_BYTES ) {
+            runs.push_back( ReadRun{ pos.file_id, end, {}, {} } );
+        }
+        auto &run = runs.back();
+        run.end   = max( run.end, end );
+        run.positions.push_back( pos );
+        run.indexes.push_back( i );
+    }
+
+    auto read_run_from = [ & ]( DataFile &data_file, const ReadRun &run ) {
+        auto records = data_file.read_log_records( run.positions );
+        for ( u64 k = 0; k < records.size(); k++ ) {
+            u64 i = run.indexes[ k ];
+            if ( records[ k ].is_err() ) {
+                results[ i ] = Err( records[ k ].unwrap_err() );
+                continue;
+            }
+            auto record = records[ k ].unwrap();
+            if ( record.rec_type == LogRecordType::DELETED ) {
+                results[ i ] = Err( Errors::KeyNotFound );
+                continue;
+            }
+            remember_value( keys[ i ], run.positions[ k ], record.value );
+            results[ i ] = Ok( std::move( record.value ) );
+        }
+    };
+
+    auto read_run = [ & ]( const ReadRun &run ) {
+        if ( data_files != nullptr ) {
+            // 快照持有其引用的所有数据文件
+            auto iter = data_files->find( run.file_id );
+            if ( iter == data_files->end() ) {
+                for ( u64 i : run.indexes ) {
+                    results[ i ] = Err( Errors::DataFileNotFound );
+                }
+                return;
+            }
+            read_run_from( *iter->second, run );
+            return;
+        }
+        auto data_file = find_data_file( run.file_id );
+        if ( data_file == nullptr ) {
+            // 数据文件刚刚被 merge 替换，逐个重新查询
+            for ( u64 i : run.indexes ) {
+                results[ i ] = get( keys[ i ] );
+            }
+            return;
+        }
+        read_run_from( *data_file, run );
+    };
+
+    // 读取较多时由多个线程并行发出，每个线程依次领取下一段读取。
+    // 获取 CPU 核数需要读取 /sys，只在第一次调用时获取
+    static const u64 cpu_num = thread::hardware_concurrency();
+    u64 workers = min( { runs.size() / MULTI_GET_RUNS_PER_THREAD,
+                         MULTI_GET_MAX_THREADS, cpu_num } );
+    atomic< u64 > next_run = 0;
+    auto          worker   = [ & ]() {
+        for ( u64 r; ( r = next_run.fetch_add( 1 ) ) < runs.size(); ) {
+            read_run( runs[ r ] );
+        }
+    };
+    vector< future< void > > futures;
+    for ( u64 t = 1; t < workers; t++ ) {
+        futures.push_back( async( launch::async, worker ) );
+    }
+    worker();
+    for ( auto &future : futures ) {
+        future.get();
+    }
+
+    vector< Result< vector< u8 >, Errors > > values;
+    values.reserve( keys.size() );
+    for ( auto &result : results ) {
+        values.push_back( std::move( *result ) );
+    }
+    return values;
+}
+
+Result< bool, Errors > Engine::del( const vector< u8 > &key ) {
+    // 判断 key 的有效性
+    if ( key.empty() ) {
+        return Err( Errors::KeyIsEmpty );
+    }
+
+    lock_guard< mutex > lock( key_lock( key ) );
+
+    // key 不存在则直接返回。延迟加载索引期间 key 可能在尚未加载的文件中，
+    // 总是写入墓碑值
+    if ( index_loaded.load( memory_order_acquire ) &&
+         !index->get( key ).has_value() ) {
+        return Ok( true );
+    }
+
+    return write_tombstone( key );
+}
+
+Result< bool, Errors >
+Engine::compare_and_swap( const vector< u8 >             &key,
+                          const optional< vector< u8 > > &expected,
+                          const vector< u8 >             &new_value ) {
+    if ( key.empty() ) {
+        return Err( Errors::KeyIsEmpty );
+    }
+
+    // 比较和写入都在 key 的锁内完成，期间其他写者无法修改该 key
+    lock_guard< mutex > lock( key_lock( key ) );
+    auto                current = read_record( key );
+    if ( current.is_err() ) {
+        return Err( current.unwrap_err() );
+    }
+    auto record = current.unwrap();
+    if ( record.has_value() != expected.has_value() ||
+         ( record.has_value() && record->value != *expected ) ) {
+        return Ok( false );
+    }
+
+    // 与 increment 一致，写入时保留原有的过期时间
+    LogRecord new_record{ key, new_value, LogRecordType::NORMAL };
+    if ( record.has_value() ) {
+        new_record.expire_at = record->expire_at;
+    }
+    return write_record( new_record );
+}
+
+Result< i64, Errors > Engine::increment( const vector< u8 > &key,
+                                         i64                 delta ) {
+    if ( key.empty() ) {
+        return Err( Errors::KeyIsEmpty );
+    }
+
+    lock_guard< mutex > lock( key_lock( key ) );
+    auto                current = read_record( key );
+    if ( current.is_err() ) {
+        return Err( current.unwrap_err() );
+    }
+
+    // value 为十进制整数，key 不存在时视为 0，写入时保留原有的过期时间
+    auto      record = current.unwrap();
+    i64       number = 0;
+    LogRecord new_record{ key, {}, LogRecordType::NORMAL };
+    if ( record.has_value() ) {
+        auto first = reinterpret_cast< const char * >( record->value.data() );
+        auto last  = first + record->value.size();
+        auto [ ptr, ec ] = from_chars( first, last, number );
+        if ( ec != errc() || ptr != last ) {
+            return Err( Errors::ValueIsNotInteger );
+        }
+        new_record.expire_at = record->expire_at;
+    }
+    if ( ( delta > 0 && number > numeric_limits< i64 >::max() - delta ) ||
+         ( delta < 0 && number < numeric_limits< i64 >::min() - delta ) ) {
+        return Err( Errors::IntegerOverflow );
+    }
+    number += delta;
+
+    auto text        = to_string( number );
+    new_record.value = vector< u8 >( text.begin(), text.end() );
+    if ( auto res = write_record( new_record ); res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+    return Ok( number );
+}
+
+Result< optional< LogRecord >, Errors >
+Engine::read_record( const vector< u8 > &key ) {
+    if ( !index_loaded.load( memory_order_acquire ) ) {
+        if ( auto res = load_lazy_files_for( key ); res.is_err() ) {
+            return Err( res.unwrap_err() );
+        }
+    }
+
+    // 持有 key 的锁时索引不会被修改，内联、缓存和读取数据文件都由
+    // read_values 处理，过期的 key 同样返回 KeyNotFound
+    auto entry  = index->get_entry( key );
+    auto values = read_values( { key }, { entry } );
+    if ( values[ 0 ].is_err() ) {
+        if ( values[ 0 ].unwrap_err() == Errors::KeyNotFound ) {
+            return Ok( optional< LogRecord >() );
+        }
+        return Err( values[ 0 ].unwrap_err() );
+    }
+    LogRecord record{ key, values[ 0 ].unwrap(), LogRecordType::NORMAL };
+    record.expire_at = entry->pos.expire_at;
+    return Ok( optional< LogRecord >( std::move( record ) ) );
+}
+
+Result< bool, Errors > Engine::write_tombstone( const vector< u8 > &key ) {
+    // 写入墓碑值，发布时删除索引。被删除的记录和墓碑值本身都是无效数据
+    LogRecord record{ key, {}, LogRecordType::DELETED };
+    auto res = append_log_record( record, [ & ]( const LogRecordPos &pos ) {
+        if ( auto old_pos = index_del( key, record.seq_no );
+             old_pos.has_value() ) {
+            add_dead_bytes( *old_pos );
+        }
+        add_dead_bytes( pos );
+        return true;
+    } );
+    if ( res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+    return Ok( true );
+}
+
+Result< bool, Errors > Engine::sync() {
+    // 先记录可读水位线再持久化，水位线之前的数据在 sync 之后一定已经落盘
+    vector< pair< u32, u64 > > durable_offs;
+    for ( auto &active : active_files ) {
+        auto data_file = active->data_file.load();
+        durable_offs.emplace_back( data_file->get_file_id(),
+                                   data_file->get_readable_off() );
+        if ( auto res = data_file->sync(); res.is_err() ) {
+            return res;
+        }
+    }
+    return save_sync_manifest( durable_offs );
+}
+
+Result< shared_ptr< DataFile >, Errors >
+Engine::writable_active_file( ActiveFile &slot, u64 len ) {
+    auto active = slot.data_file.load();
+
+    // 判断当前活跃文件是否到达了阈值
+    if ( active->get_write_off() + len <= options.data_file_size ) {
+        return Ok( active );
+    }
+
+    // 等待旧活跃文件上的写入全部发布，保证跨文件的索引更新顺序
+    active->wait_published();
+
+    // 将当前活跃文件进行持久化
+    if ( auto res = active->sync(); res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+
+    // 先发布包含旧活跃文件的 older_files，再切换活跃文件，
+    // 保证读者在任意时刻都能找到索引中引用的文件
+    replace_older_files( {}, { active } );
+    schedule_hint_file( active );
+
+    // 打开新的数据文件
+    try {
+        active = make_shared< DataFile >( options.dir_path,
+                                          next_file_id.fetch_add( 1 ) );
+    } catch ( const runtime_error & ) {
+        return Err( Errors::FailedToOpenDataFile );
+    }
+    set_active_file( slot, active );
+    return Ok( active );
+}
+
+Result< LogRecordPos, Errors > Engine::append_log_record(
+    LogRecord &record,
+    const function< bool( const LogRecordPos & ) > &update_index ) {
+    // 分配全局序列号，并对输入数据进行编码
+    record.seq_no   = seq_no.fetch_add( 1 ) + 1;
+    auto enc_record = record.encode();
+    u64  record_len = enc_record.size();
+
+    auto                  &slot = pick_active_file();
+    shared_ptr< DataFile > active;
+    u64                    write_off   = 0;
+    u32                    record_slot = 0;
+    {
+        // 只在预留写入区域时持有写锁
+        lock_guard< mutex > lock( slot.write_mutex );
+        auto                writable = writable_active_file( slot, record_len );
+        if ( writable.is_err() ) {
+            return Err( writable.unwrap_err() );
+        }
+        active      = writable.unwrap();
+        write_off   = active->reserve( record_len );
+        record_slot = active->reserve_slots( 1 );
+        active->observe_seq_no( record.seq_no );
+    }
+
+    // 并行写入各自预留的区域，并根据配置项决定是否持久化
+    auto res = active->write_at( enc_record, write_off );
+    if ( res.is_ok() && options.sync_writes ) {
+        if ( auto sync_res = active->sync(); sync_res.is_err() ) {
+            res = Err( sync_res.unwrap_err() );
+        }
+    }
+
+    // 按照预留顺序发布数据并更新索引，写入失败时同样需要发布，避免阻塞后续写者
+    LogRecordPos pos( active->get_file_id(), write_off,
+                      static_cast< u32 >( record_len ), record_slot );
+    pos.expire_at      = record.expire_at;
+    bool index_updated = false;
+    active->publish( write_off, record_len, [ & ] {
+        index_updated = res.is_ok() && update_index( pos );
+    } );
+
+    if ( res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+    if ( !index_updated ) {
+        return Err( Errors::IndexUpdateFailed );
+    }
+    return Ok( pos );
+}
+
+Result< bool, Errors > Engine::append_log_records(
+    vector< LogRecord > &records, bool sync,
+    const function< bool( u64, const LogRecordPos & ) > &update_index ) {
+    // 连续分配序列号，所有记录编码到同一个缓冲区中
+    u64           first_seq = seq_no.fetch_add( records.size() ) + 1;
+    vector< u8 >  buf;
+    vector< u64 > lens;
+    for ( u64 i = 0; i < records.size(); i++ ) {
+        records[ i ].seq_no = first_seq + i;
+        auto enc_record     = records[ i ].encode();
+        buf.insert( buf.end(), enc_record.begin(), enc_record.end() );
+        lens.push_back( enc_record.size() );
+    }
+
+    auto                  &slot = pick_active_file();
+    shared_ptr< DataFile > active;
+    u64                    write_off  = 0;
+    u32                    first_slot = 0;
+    {
+        // 一次预留所有记录的区域，不会被其他写者的记录隔开
+        lock_guard< mutex > lock( slot.write_mutex );
+        auto                writable = writable_active_file( slot, buf.size() );
+        if ( writable.is_err() ) {
+            return Err( writable.unwrap_err() );
+        }
+        active     = writable.unwrap();
+        write_off  = active->reserve( buf.size() );
+        first_slot = active->reserve_slots(
+            static_cast< u32 >( records.size() ) );
+        active->observe_seq_no( first_seq );
+    }
+
+    u64  total_len = buf.size();
+    auto res       = active->write_at( buf, write_off );
+    if ( res.is_ok() && sync ) {
+        if ( auto sync_res = active->sync(); sync_res.is_err() ) {
+            res = Err( sync_res.unwrap_err() );
+        }
+    }
+
+    // 整个区域一次发布，按记录顺序更新索引
+    bool index_updated = res.is_ok();
+    active->publish( write_off, total_len, [ & ] {
+        u64 offset = write_off;
+        for ( u64 i = 0; i < records.size() && index_updated; i++ ) {
+            LogRecordPos pos( active->get_file_id(), offset,
+                              static_cast< u32 >( lens[ i ] ),
+                              first_slot + static_cast< u32 >( i ) );
+            pos.expire_at = records[ i ].expire_at;
+            index_updated = update_index( i, pos );
+            offset += lens[ i ];
+        }
+    } );
+
+    if ( res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+    if ( !index_updated ) {
+        return Err( Errors::IndexUpdateFailed );
+    }
+    return Ok( true );
+}
+
+vector< vector< u8 > > Engine::list_keys() {
+    wait_index_loaded();
+    vector< vector< u8 > > keys;
+    for ( auto &[ key, pos ] : index->list_entries() ) {
+        if ( !is_expired( pos ) ) {
+            keys.push_back( std::move( key ) );
+        }
+    }
+    return keys;
+}
+
+Result< bool, Errors > Engine::fold(
+    const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+        &fn ) {
+    return scan( IteratorOptions(), fn );
+}
+
+Result< bool, Errors > Engine::scan(
+    const IteratorOptions &options,
+    const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+        &fn ) {
+    if ( auto res = wait_index_loaded(); res.is_err() ) {
+        return res;
+    }
+
+    auto iter = index->iterator( options );
+    return scan_index( *iter, nullptr, fn );
+}
+
+Result< bool, Errors > Engine::scan_index(
+    IndexIterator &iter, const DataFileMap *data_files,
+    const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+        &fn ) {
+    // 每次从迭代器取出一批 key，处理当前这批时由另一个线程读取下一批的 value
+    auto next_window = [ & ]() {
+        vector< vector< u8 > >           keys;
+        vector< optional< IndexEntry > > entries;
+        for ( ; iter.valid() && keys.size() < SCAN_PREFETCH_NUM;
+              iter.next() ) {
+            keys.push_back( iter.key() );
+            entries.push_back( iter.entry() );
+        }
+        return make_pair( std::move( keys ), std::move( entries ) );
+    };
+
+    auto window = next_window();
+    auto values = read_values( window.first, window.second, data_files );
+    while ( !window.first.empty() ) {
+        auto next    = next_window();
+        auto policy  = next.first.empty() ? launch::deferred : launch::async;
+        auto pending = async( policy, [ & ]() {
+            return read_values( next.first, next.second, data_files );
+        } );
+
+        for ( u64 i = 0; i < window.first.size(); i++ ) {
+            auto &value = values[ i ];
+            if ( value.is_err() ) {
+                // 遍历过程中被并发删除的 key 直接跳过
+                if ( value.unwrap_err() == Errors::KeyNotFound ) {
+                    continue;
+                }
+                pending.wait();
+                return Err( value.unwrap_err() );
+            }
+            if ( !fn( window.first[ i ], value.unwrap() ) ) {
+                pending.wait();
+                return Ok( true );
+            }
+        }
+
+        values = pending.get();
+        window = std::move( next );
+    }
+    return Ok( true );
+}
+
+CacheStats Engine::cache_stats() const {
+    if ( value_cache == nullptr ) {
+        return CacheStats{};
+    }
+    return value_cache->stats();
+}
+
+u64 Engine::inline_value_bytes() const {
+    return index->inline_value_bytes();
+}
+
+Engine::ActiveFile &Engine::pick_active_file() {
+    if ( active_files.size() == 1 ) {
+        return *active_files[ 0 ];
+    }
+    // 同一个线程总是写入同一个活跃文件
+    auto thread_hash = hash< thread::id >{}( this_thread::get_id() );
+    return *active_files[ thread_hash % active_files.size() ];
+}
+
+void Engine::set_active_file( ActiveFile            &slot,
+                              shared_ptr< DataFile > data_file ) {
+    ActiveFileInfo info;
+    info.file_id = data_file->get_file_id();
+    slot.data_file.store( std::move( data_file ) );
+    slot.info.store( info );
+}
+
+mutex &Engine::key_lock( const vector< u8 > &key ) {
+    string_view key_view( reinterpret_cast< const char * >( key.data() ),
+                          key.size() );
+    return key_locks[ hash< string_view >{}( key_view ) % KEY_LOCK_NUM ];
+}
+
+vector< unique_lock< mutex > >
+Engine::lock_in_order( vector< mutex * > mutexes ) {
+    sort( mutexes.begin(), mutexes.end() );
+    mutexes.erase( unique( mutexes.begin(), mutexes.end() ), mutexes.end() );
+    vector< unique_lock< mutex > > locks;
+    locks.reserve( mutexes.size() );
+    for ( auto *m : mutexes ) {
+        locks.emplace_back( *m );
+    }
+    return locks;
+}
+
+bool Engine::should_inline( const vector< u8 > &value ) const {
+    return options.inline_value_size > 0 &&
+           value.size() <= options.inline_value_size;
+}
+
+void Engine::remember_value( const vector< u8 > &key, const LogRecordPos &pos,
+                             const vector< u8 > &value ) {
+    // 从 hint 文件或索引快照加载的小 value 在第一次读取时内联
+    if ( should_inline( value ) ) {
+        index->set_inline_value( key, pos, InlineValue( value ) );
+    } else if ( value_cache != nullptr ) {
+        value_cache->put( pos, value );
+    }
+}
+
+void Engine::replace_older_files(
+    const vector< u32 >                  &removed,
+    const vector< shared_ptr< DataFile > > &added ) {
+    lock_guard< mutex > lock( older_files_mutex );
+    auto new_older = make_shared< DataFileMap >( *older_files.load() );
+    for ( u32 file_id : removed ) {
+        new_older->erase( file_id );
+    }
+    for ( const auto &data_file : added ) {
+        new_older->emplace( data_file->get_file_id(), data_file );
+    }
+    older_files.store( std::move( new_older ) );
+}
+
+void Engine::background_loop() {
+    auto merge_interval = chrono::milliseconds( options.merge_interval_ms );
+    auto next_merge     = chrono::steady_clock::now() + merge_interval;
+
+    unique_lock< mutex > lock( background_mutex );
+    while ( true ) {
+        auto has_work = [ this ] {
+            return background_stop || !pending_hint_files.empty();
+        };
+        if ( options.merge_interval_ms > 0 ) {
+            background_cv.wait_until( lock, next_merge, has_work );
+        } else {
+            background_cv.wait( lock, has_work );
+        }
+
+        // 停止时也要处理完剩余的 hint 文件，下次打开时可以直接使用。
+        // 执行期间不持有 background_mutex，不阻塞写者切换活跃文件
+        while ( !pending_hint_files.empty() ) {
+            auto data_file = std::move( pending_hint_files.back() );
+            pending_hint_files.pop_back();
+            lock.unlock();
+            generate_hint_file( *data_file );
+            lock.lock();
+        }
+        if ( background_stop ) {
+            break;
+        }
+
+        // 索引加载完成之前无法判断记录是否有效，推迟 merge
+        if ( options.merge_interval_ms > 0 && index_loaded &&
+             chrono::steady_clock::now() >= next_merge ) {
+            lock.unlock();
+            merge();
+            lock.lock();
+            next_merge = chrono::steady_clock::now() + merge_interval;
+        }
+    }
+}
+
+void Engine::schedule_hint_file( shared_ptr< DataFile > data_file ) {
+    {
+        lock_guard< mutex > lock( background_mutex );
+        pending_hint_files.push_back( std::move( data_file ) );
+    }
+    background_cv.notify_all();
+}
+
+Result< bool, Errors > Engine::generate_hint_file( DataFile &data_file ) {
+    auto records = build_hint_records( data_file );
+    if ( records.is_err() ) {
+        return Err( records.unwrap_err() );
+    }
+    u32  file_id = data_file.get_file_id();
+    auto res = write_hint_file( options.dir_path, file_id, records.unwrap() );
+
+    // 数据文件可能在此期间被 merge 删除，merge 先移除文件再删除 hint 文件，
+    // 这里写完之后再检查一次，不会留下孤立的 hint 文件
+    if ( find_data_file( file_id ) == nullptr ) {
+        remove_hint_file( options.dir_path, file_id );
+    }
+    return res;
+}
+
+optional< LogRecordPos > Engine::index_put( const vector< u8 > &key,
+                                            const LogRecordPos &pos,
+                                            u64                 seq_no,
+                                            InlineValue         value ) {
+    if ( !index_loaded.load( memory_order_acquire ) ) {
+        lock_guard< mutex > lock( lazy_mutex );
+        if ( !index_loaded.load( memory_order_relaxed ) ) {
+            lazy_key_seqs[ string( key.begin(), key.end() ) ] = seq_no;
+            return index->put( key, pos, std::move( value ) );
+        }
+    }
+    return index->put( key, pos, std::move( value ) );
+}
+
+optional< LogRecordPos > Engine::index_del( const vector< u8 > &key,
+                                            u64                 seq_no ) {
+    if ( !index_loaded.load( memory_order_acquire ) ) {
+        lock_guard< mutex > lock( lazy_mutex );
+        if ( !index_loaded.load( memory_order_relaxed ) ) {
+            lazy_key_seqs[ string( key.begin(), key.end() ) ] = seq_no;
+            return index->del( key );
+        }
+    }
+    return index->del( key );
+}
+
+void Engine::apply_loaded_record( unordered_map< string, u64 > &key_seqs,
+                                  HintRecord                   &record ) {
+    auto &key_seq = key_seqs[ string( record.key.begin(), record.key.end() ) ];
+    optional< LogRecordPos > dead_pos;
+    if ( record.seq_no < key_seq ) {
+        dead_pos = record.pos;
+    } else {
+        key_seq = record.seq_no;
+        if ( record.rec_type == LogRecordType::NORMAL ) {
+            if ( record.pos.expire_at != 0 ) {
+                track_expiry( record.key, record.pos.expire_at );
+            }
+            dead_pos = index->put( std::move( record.key ), record.pos );
+        } else if ( record.rec_type == LogRecordType::DELETED ) {
+            dead_pos = index->del( std::move( record.key ) );
+            add_dead_bytes( record.pos );
+        }
+    }
+    if ( dead_pos.has_value() ) {
+        add_dead_bytes( *dead_pos );
+    }
+}
+
+void Engine::lazy_load_loop() {
+    for ( u64 i = 0; i < lazy_files.size(); i++ ) {
+        if ( lazy_load_stop ) {
+            return;
+        }
+        if ( auto res = load_lazy_file( i ); res.is_err() ) {
+            lock_guard< mutex > lock( lazy_mutex );
+            lazy_load_error = res.unwrap_err();
+            lazy_cv.notify_all();
+            return;
+        }
+    }
+
+    // 所有文件都已加载，之后的读写不再需要记录序列号
+    lock_guard< mutex > lock( lazy_mutex );
+    lazy_files.clear();
+    lazy_key_seqs.clear();
+    index_loaded = true;
+    lazy_cv.notify_all();
+}
+
+Result< bool, Errors > Engine::load_lazy_file( u64 i ) {
+    shared_ptr< DataFile > data_file;
+    {
+        unique_lock< mutex > lock( lazy_mutex );
+        if ( index_loaded ) {
+            return Ok( true );
+        }
+        lazy_cv.wait( lock, [ & ] { return !lazy_files[ i ].loading; } );
+        if ( lazy_files[ i ].loaded ) {
+            return Ok( true );
+        }
+        lazy_files[ i ].loading = true;
+        data_file               = lazy_files[ i ].data_file;
+    }
+
+    // 解码 hint 文件时不持有锁，合并到索引时分批持有锁。
+    // 记录是否生效只取决于序列号，与文件的加载顺序无关
+    auto res = load_data_file( options.dir_path, *data_file, true, 0 );
+    if ( res.is_ok() ) {
+        auto loaded = res.unwrap();
+        data_file->set_write_off( loaded.write_off );
+        data_file->add_dead_bytes( loaded.dead_bytes );
+
+        auto &records = loaded.records;
+        for ( u64 begin = 0; begin < records.size();
+              begin += LAZY_LOAD_BATCH_SIZE ) {
+            u64 end = min( begin + LAZY_LOAD_BATCH_SIZE, records.size() );
+            lock_guard< mutex > lock( lazy_mutex );
+            for ( u64 j = begin; j < end; j++ ) {
+                apply_loaded_record( lazy_key_seqs, records[ j ] );
+            }
+        }
+    }
+
+    lock_guard< mutex > lock( lazy_mutex );
+    lazy_files[ i ].loading = false;
+    lazy_files[ i ].loaded  = res.is_ok();
+    lazy_cv.notify_all();
+    if ( res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+    return Ok( true );
+}
+
+Result< bool, Errors > Engine::load_lazy_files_for( const vector< u8 > &key ) {
+    // 只有最大序列号比该 key 已知的记录更大的文件才可能包含更新的记录，
+    // 打开之后写入过的 key 不需要加载任何文件
+    vector< u64 > candidates;
+    {
+        lock_guard< mutex > lock( lazy_mutex );
+        if ( index_loaded ) {
+            return Ok( true );
+        }
+        u64  known_seq_no = 0;
+        auto iter = lazy_key_seqs.find( string( key.begin(), key.end() ) );
+        if ( iter != lazy_key_seqs.end() ) {
+            known_seq_no = iter->second;
+        }
+        for ( u64 i = 0; i < lazy_files.size(); i++ ) {
+            const auto &file = lazy_files[ i ];
+            if ( !file.loaded && file.summary.max_seq_no > known_seq_no &&
+                 file.summary.may_contain( key ) ) {
+                candidates.push_back( i );
+            }
+        }
+    }
+
+    for ( u64 i : candidates ) {
+        if ( auto res = load_lazy_file( i ); res.is_err() ) {
+            return res;
+        }
+    }
+    return Ok( true );
+}
+
+Result< bool, Errors > Engine::wait_index_loaded() {
+    unique_lock< mutex > lock( lazy_mutex );
+    lazy_cv.wait( lock, [ this ] {
+        return index_loaded || lazy_load_error.has_value();
+    } );
+    if ( !index_loaded ) {
+        return Err( *lazy_load_error );
+    }
+    return Ok( true );
+}
+
+void Engine::add_dead_bytes( const LogRecordPos &pos ) {
+    // 文件可能已经被 merge 删除，此时不需要再统计
+    auto data_file = find_data_file( pos.file_id );
+    if ( data_file != nullptr ) {
+        data_file->add_dead( pos );
+    }
+}
+
+Result< bool, Errors > Engine::save_sync_manifest(
+    const vector< pair< u32, u64 > > &durable_offs ) {
+    // 每行为文件 id 和已经持久化的位置，先写入临时文件再重命名
+    auto manifest_path = filesystem::path( options.dir_path ) /
+                         SYNC_MANIFEST_NAME;
+    auto tmp_path      = manifest_path;
+    tmp_path += ".tmp";
+    {
+        ofstream out( tmp_path, ios::trunc );
+        for ( const auto &[ file_id, offset ] : durable_offs ) {
+            out << file_id << " " << offset << "\n";
+        }
+        if ( !out.flush() ) {
+            return Err( Errors::FailedToWriteToDataFile );
+        }
+    }
+    error_code ec;
+    filesystem::rename( tmp_path, manifest_path, ec );
+    if ( ec ) {
+        return Err( Errors::FailedToWriteToDataFile );
+    }
+    return Ok( true );
+}
+
+unordered_map< u32, u64 > Engine::load_sync_manifest() {
+    unordered_map< u32, u64 > durable_offs;
+    ifstream in( filesystem::path( options.dir_path ) / SYNC_MANIFEST_NAME );
+    u32      file_id = 0;
+    u64      offset  = 0;
+    while ( in >> file_id >> offset ) {
+        durable_offs[ file_id ] = offset;
+    }
+    return durable_offs;
+}
+
+shared_ptr< DataFile > Engine::find_data_file( u32 file_id ) const {
+    // 先通过元数据找到对应的槽位，只加载这一个槽位中的文件。
+    // 文件在此期间可能已经被切换为旧数据文件，切换时先加入 older_files
+    for ( const auto &slot : active_files ) {
+        if ( slot->info.load().file_id != file_id ) {
+            continue;
+        }
+        auto active = slot->data_file.load();
+        if ( active != nullptr && active->get_file_id() == file_id ) {
+            return active;
+        }
+    }
+
+    auto older = older_files.load();
+    auto iter  = older->find( file_id );
+    if ( iter == older->end() ) {
+        return nullptr;
+    }
+    return iter->second;
+}
+
+Result< bool, Errors > Engine::load_data_files() {
+    error_code ec;
+    auto       dir = filesystem::directory_iterator( options.dir_path, ec );
+    if ( ec ) {
+        return Err( Errors::FailedToReadDatabaseDir );
+    }
+
+    vector< filesystem::path > retired;
+    for ( const auto &entry : dir ) {
+        // 上次退出时仍被快照引用的 merge 输入文件，已经不再需要
+        auto path = entry.path();
+        if ( path.extension() == RETIRED_FILE_NAME_SUFFIX ) {
+            retired.push_back( path );
+            continue;
+        }
+        // 判断文件是不是以 .data 为扩展名
+        if ( path.extension() != DATA_FILE_NAME_SUFFIX ) {
+            continue;
+        }
+        try {
+            file_ids.push_back(
+                static_cast< u32 >( stoul( path.stem().string() ) ) );
+        } catch ( const logic_error & ) {
+            return Err( Errors::DataDirCorrupted );
+        }
+    }
+
+    for ( const auto &path : retired ) {
+        filesystem::remove( path, ec );
+    }
+
+    // 对文件 id 进行排序，从小到大依次加载
+    sort( file_ids.begin(), file_ids.end() );
+
+    next_file_id = file_ids.empty() ? 0 : file_ids.back() + 1;
+
+    // 最后的 active_file_num 个没有 hint 文件的数据文件继续作为活跃文件，
+    // 其余都是旧的数据文件，不足时新建数据文件。
+    // 活跃文件切换出去之后才由后台生成 hint 文件，而 merge 的输出文件 id 比
+    // 活跃文件大，但完成时已经写好 hint 文件，不能被当作活跃文件继续写入
+    u64           active_num = active_files.size();
+    vector< u32 > active_ids;
+    for ( auto iter = file_ids.rbegin();
+          iter != file_ids.rend() && active_ids.size() < active_num; iter++ ) {
+        if ( !filesystem::exists(
+                 get_hint_file_name( options.dir_path, *iter ) ) ) {
+            active_ids.push_back( *iter );
+        }
+    }
+    reverse( active_ids.begin(), active_ids.end() );
+
+    try {
+        auto older = make_shared< DataFileMap >();
+        for ( u32 file_id : file_ids ) {
+            if ( find( active_ids.begin(), active_ids.end(), file_id ) ==
+                 active_ids.end() ) {
+                older->emplace( file_id, make_shared< DataFile >(
+                                             options.dir_path, file_id ) );
+            }
+        }
+        older_files.store( std::move( older ) );
+
+        for ( u64 i = 0; i < active_num; i++ ) {
+            u32 active_fid = i < active_ids.size()
+                                 ? active_ids[ i ]
+                                 : next_file_id.fetch_add( 1 );
+            set_active_file(
+                *active_files[ i ],
+                make_shared< DataFile >( options.dir_path, active_fid ) );
+        }
+    } catch ( const runtime_error & ) {
+        return Err( Errors::FailedToOpenDataFile );
+    }
+    return Ok( true );
+}
+
+Result< bool, Errors > Engine::load_index_from_data_files() {
+    // 数据文件为空，直接返回
+    if ( file_ids.empty() ) {
+        return Ok( true );
+    }
+
+    // 先从索引快照中恢复，之后只需要重放快照之后写入的数据
+    auto snapshot_files = load_index_snapshot();
+    u64  max_seq_no     = seq_no;
+
+    // 活跃文件以及上次 sync 时仍是活跃文件的数据文件在崩溃前可能正在被写入，
+    // 需要校验尾部。新切换出的活跃文件没有记录，从头开始校验
+    auto durable_offs = load_sync_manifest();
+
+    // 延迟加载时，同时具有 hint 文件和 key 摘要的旧数据文件留给后台线程，
+    // 从新到旧加载，其余文件仍然在打开时加载。摘要中的最大序列号保证
+    // 打开之后写入的记录比这些文件中的记录都新
+    vector< u32 > load_ids;
+    if ( options.lazy_index_load && snapshot_files.empty() ) {
+        auto older = older_files.load();
+        for ( auto iter = file_ids.rbegin(); iter != file_ids.rend(); iter++ ) {
+            auto older_iter = older->find( *iter );
+            if ( older_iter != older->end() &&
+                 filesystem::exists(
+                     get_hint_file_name( options.dir_path, *iter ) ) ) {
+                auto summary = read_key_summary( options.dir_path, *iter );
+                if ( summary.is_ok() ) {
+                    auto &file = lazy_files.emplace_back(
+                        LazyFile{ older_iter->second, summary.unwrap() } );
+                    max_seq_no = max( max_seq_no, file.summary.max_seq_no );
+                    continue;
+                }
+            }
+            load_ids.push_back( *iter );
+        }
+        reverse( load_ids.begin(), load_ids.end() );
+    } else {
+        load_ids = file_ids;
+    }
+
+    // 每个数据文件 (或其 hint 文件) 的解码都是独立的，交给多个线程并行完成，
+    // 当前线程再按文件 id 的顺序依次合并到内存索引中。
+    // 最多同时解码 window 个文件，限制尚未合并的记录占用的内存
+    u64 thread_num = options.index_load_threads;
+    if ( thread_num == 0 ) {
+        thread_num = max( 1u, thread::hardware_concurrency() );
+    }
+    u64 window = thread_num * 2;
+
+    deque< future< Result< LoadedDataFile, Errors > > > loading;
+    u64                                                 next = 0;
+    auto load_next = [ & ]() {
+        u32  file_id   = load_ids[ next++ ];
+        auto data_file = find_data_file( file_id );
+        bool is_older  = older_files.load()->count( file_id ) > 0;
+        u64  start     = 0;
+        if ( auto iter = snapshot_files.find( file_id );
+             iter != snapshot_files.end() ) {
+            start = iter->second.watermark;
+        }
+
+        // 活跃文件会被继续追加，已有的 hint 文件不再完整
+        optional< u64 > durable_off;
+        if ( auto iter = durable_offs.find( file_id );
+             iter != durable_offs.end() ) {
+            durable_off = iter->second;
+        }
+        if ( !is_older ) {
+            remove_hint_file( options.dir_path, file_id );
+            durable_off = durable_off.value_or( 0 );
+        }
+        loading.push_back( async(
+            launch::async, [ this, data_file, is_older, start, durable_off ] {
+                return load_data_file( options.dir_path, *data_file, is_older,
+                                       start, durable_off );
+            } ) );
+    };
+
+    // 多个活跃文件时，同一个 key 的新旧不能由文件 id 决定，
+    // 记录每个 key 已经加载的最大序列号，只有更新的记录才会覆盖索引。
+    // 快照之后写入的记录一定比快照中同一个 key 的记录更新
+    unordered_map< string, u64 > key_seqs;
+
+    for ( u32 file_id : load_ids ) {
+        while ( next < load_ids.size() && loading.size() < window ) {
+            load_next();
+        }
+        auto res = loading.front().get();
+        loading.pop_front();
+        if ( res.is_err() ) {
+            // 等待其他解码任务结束之后再返回
+            loading.clear();
+            return Err( res.unwrap_err() );
+        }
+
+        auto loaded    = res.unwrap();
+        auto data_file = find_data_file( file_id );
+        data_file->set_write_off( loaded.write_off );
+        data_file->add_dead_bytes( loaded.dead_bytes );
+        max_seq_no = max( max_seq_no, loaded.max_seq_no );
+
+        // 将记录合并到内存索引中，同时重新统计每个文件中的无效数据
+        for ( auto &record : loaded.records ) {
+            apply_loaded_record( key_seqs, record );
+        }
+
+        // 缺少 hint 文件的旧数据文件交给后台线程补齐
+        if ( older_files.load()->count( file_id ) > 0 && !loaded.from_hint &&
+             !snapshot_files.count( file_id ) ) {
+            schedule_hint_file( data_file );
+        }
+    }
+
+    seq_no = max_seq_no;
+
+    // 剩余文件的索引交给后台线程加载，保留已加载的 key 的序列号
+    if ( !lazy_files.empty() ) {
+        lazy_key_seqs = std::move( key_seqs );
+        index_loaded  = false;
+    }
+    return Ok( true );
+}
+
+} // namespace bitcask
@@ -0,0 +1,468 @@
+#pragma once
+
+#include "cache/value_cache.h"
+#include "data/data_file.h"
+#include "data/hint_file.h"
+#include "data/log_record.h"
+#include "errors.h"
+#include "index/btree.h"
+#include "index/snapshot.h"
+#include "options.h"
+#include "utils/AtomicSharedPtr.h"
+#include "utils/RateLimiter.h"
+#include "utils/Result.h"
+#include "utils/SeqLock.h"
+#include "utils/TimerWheel.h"
+#include "utils/nocopyable.h"
+#include "utils/type.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+namespace bitcask {
+
+// 记录每个活跃文件上次 sync 时已经持久化的位置的文件，
+// 崩溃恢复时只需要校验这之后的数据
+constexpr string_view SYNC_MANIFEST_NAME = "SYNC_MANIFEST";
+
+// merge 时仍被快照引用的输入文件改为该后缀，快照释放后再删除，
+// 打开数据库时清理残留的这类文件
+constexpr string_view RETIRED_FILE_NAME_SUFFIX = ".retired";
+
+class Snapshot;
+class WriteBatch;
+
+// bitcask 存储引擎实例
+//
+// 读路径不加任何全局锁: 活跃文件和旧数据文件集合都以 shared_ptr 的形式原子发布，
+// get 只需原子地拿到目标 DataFile 的引用计数，再通过 pread 并发读取;
+// 写路径只在预留写入区域时持有活跃文件的 write_mutex，多个写者随后并行拷贝数据，
+// 再按预留顺序发布并更新索引。
+//
+// snapshot 返回某一时刻的只读视图: 索引视图记录之后被覆盖的旧位置，
+// 视图引用的数据文件在快照释放之前不会被 merge 删除。
+//
+// 可以同时打开多个活跃文件，不同线程写入不同的活跃文件。每条记录都带有全局单调
+// 递增的序列号，同一个 key 的写入由 key_locks 串行化，保证序列号的顺序就是索引
+// 更新的顺序，加载索引时以序列号判断同一个 key 的新旧。
+//
+// 后台线程为写满的数据文件生成 hint 文件，打开时读取 hint 文件即可重建索引;
+// 同时定期执行 merge，重写旧数据文件中仍然有效的记录，见 merge.cpp。
+class Engine : public Nocopyable,
+               public enable_shared_from_this< Engine > {
+  public:
+    using DataFileMap = map< u32, shared_ptr< DataFile > >;
+
+    // 对 key 加锁的分段数量
+    static constexpr u64 KEY_LOCK_NUM = 64;
+
+    // scan 每次预先读取 value 的记录数
+    static constexpr u64 SCAN_PREFETCH_NUM = 64;
+
+    // 打开 bitcask 存储引擎实例
+    static Result< shared_ptr< Engine >, Errors >
+    open( const Options &options );
+
+    // 停止后台线程并持久化所有活跃文件
+    ~Engine();
+
+    // 存储 key/value 数据，key 不能为空。ttl_ms 不为 0 时数据在 ttl_ms 毫秒
+    // 之后过期，过期之后读取不到，并由后台线程写入墓碑值
+    Result< bool, Errors > put( const vector< u8 > &key,
+                                const vector< u8 > &value, u64 ttl_ms = 0 );
+
+    // 根据 key 获取对应的数据
+    Result< vector< u8 >, Errors > get( const vector< u8 > &key );
+
+    // 批量获取数据，结果与 keys 的顺序一一对应。一次查询所有 key 的索引，
+    // 按 (文件 id, 偏移) 排序后合并相邻记录的读取，并行发出
+    vector< Result< vector< u8 >, Errors > >
+    multi_get( const vector< vector< u8 > > &keys );
+
+    // 根据 key 删除对应的数据
+    Result< bool, Errors > del( const vector< u8 > &key );
+
+    // 当前的 value 等于 expected 时写入 new_value，expected 为 nullopt
+    // 表示 key 不存在。保留原有的过期时间，比较和写入在 key 的锁内完成，
+    // 返回是否写入
+    Result< bool, Errors >
+    compare_and_swap( const vector< u8 >             &key,
+                      const optional< vector< u8 > > &expected,
+                      const vector< u8 >             &new_value );
+
+    // 将 value 作为十进制整数加上 delta 并返回结果，key 不存在时视为 0，
+    // 保留原有的过期时间。读取和写入在 key 的锁内完成
+    Result< i64, Errors > increment( const vector< u8 > &key, i64 delta );
+
+    // 持久化所有活跃文件，并记录持久化的位置
+    Result< bool, Errors > sync();
+
+    // 按顺序获取数据库中所有的 key，延迟加载索引时会等待加载完成
+    vector< vector< u8 > > list_keys();
+
+    // 按 key 的顺序遍历所有数据，fn 返回 false 时停止遍历。
+    // 延迟加载索引时会等待加载完成
+    Result< bool, Errors > fold(
+        const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+            &fn );
+
+    // 按 options 指定的范围和方向遍历数据，fn 返回 false 时停止遍历。
+    // 处理当前一批数据时预先读取之后一批的 value，隐藏读取数据文件的延迟。
+    // 延迟加载索引时会等待加载完成
+    Result< bool, Errors > scan(
+        const IteratorOptions &options,
+        const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+            &fn );
+
+    // 重写所有旧数据文件中的有效数据，丢弃无效数据，不阻塞前台读写
+    Result< bool, Errors > merge();
+
+    // 将内存索引持久化为索引快照，下次打开时只需重放快照之后写入的数据。
+    // 拷贝索引期间会短暂阻塞写入。merge 会让快照失效，
+    // 存在快照时 merge 成功之后会重新生成
+    Result< bool, Errors > checkpoint();
+
+    // 创建当前时刻的只读快照，之后的写入和 merge 对快照不可见。
+    // 延迟加载索引时会等待加载完成
+    Result< shared_ptr< Snapshot >, Errors > snapshot();
+
+    // 创建批量写入，暂存的写入在 commit 时一起生效
+    unique_ptr< WriteBatch >
+    new_write_batch( const WriteBatchOptions &options = WriteBatchOptions() );
+
+    // value 缓存的命中统计，未开启缓存时全部为 0
+    CacheStats cache_stats() const;
+
+    // 内存索引中内联的 value 占用的堆内存字节数
+    u64 inline_value_bytes() const;
+
+  private:
+    friend class Snapshot;
+    friend class WriteBatch;
+    friend class PartitionedEngine;
+
+    // 活跃文件的元数据，读者通过顺序锁读取，不修改任何共享的缓存行
+    struct ActiveFileInfo {
+        // 尚未打开时为 UINT32_MAX
+        u32 file_id = UINT32_MAX;
+    };
+
+    // 活跃文件槽位，每个槽位有独立的写锁和追加位置
+    struct ActiveFile {
+        AtomicSharedPtr< DataFile > data_file;
+        // 只需要元数据的读者不必加载 data_file (自旋锁以及引用计数都会写共享的
+        // 缓存行)，由 set_active_file 与 data_file 一起更新
+        SeqLock< ActiveFileInfo > info;
+        mutex                     write_mutex;
+    };
+
+    // 延迟加载索引的旧数据文件
+    struct LazyFile {
+        shared_ptr< DataFile > data_file;
+        KeySummary             summary;
+        bool                   loading = false;
+        bool                   loaded  = false;
+    };
+
+    explicit Engine( const Options &options );
+
+    // 追加写数据到当前线程对应的活跃文件中，调用方需持有 key 对应的锁，
+    // update_index 在数据发布时按写入顺序执行
+    Result< LogRecordPos, Errors > append_log_record(
+        LogRecord &record,
+        const function< bool( const LogRecordPos & ) > &update_index );
+
+    // 一次追加多条记录: 在同一个活跃文件中预留一段连续的区域，一次写入、
+    // 一次发布，发布时按顺序对每条记录调用 update_index。sync 为 true 时
+    // 发布之前持久化。调用方需持有所有 key 对应的锁
+    Result< bool, Errors > append_log_records(
+        vector< LogRecord > &records, bool sync,
+        const function< bool( u64, const LogRecordPos & ) > &update_index );
+
+    // 返回可以再追加 len 字节的活跃文件，空间不足时持久化并切换到新的数据文件。
+    // 调用方需持有槽位的写锁
+    Result< shared_ptr< DataFile >, Errors >
+    writable_active_file( ActiveFile &slot, u64 len );
+
+    // 根据当前线程选择活跃文件槽位
+    ActiveFile &pick_active_file();
+
+    // 替换槽位中的活跃文件并发布其元数据
+    void set_active_file( ActiveFile &slot, shared_ptr< DataFile > data_file );
+
+    // key 对应的分段锁
+    mutex &key_lock( const vector< u8 > &key );
+
+    // 按地址顺序获取 mutexes 中的锁 (与 checkpoint 获取全部锁的顺序一致)，
+    // 相同的锁只获取一次
+    vector< unique_lock< mutex > > lock_in_order( vector< mutex * > mutexes );
+
+    // 将批量写入的记录与提交标识一次追加到同一个活跃文件中并更新索引
+    Result< bool, Errors > write_batch( vector< LogRecord > &records,
+                                        bool                 sync );
+
+    // 写入一条数据并更新索引，调用方需持有 key 对应的锁
+    Result< bool, Errors > write_record( LogRecord &record );
+
+    // 读取 key 当前的数据，key 不存在或已经过期时返回 nullopt，
+    // 调用方需持有 key 对应的锁
+    Result< optional< LogRecord >, Errors >
+    read_record( const vector< u8 > &key );
+
+    // 写入 key 的墓碑值并删除索引，调用方需持有 key 对应的锁
+    Result< bool, Errors > write_tombstone( const vector< u8 > &key );
+
+    // 位置上的记录是否已经过期，使用后台线程维护的粗粒度时钟，不需要系统调用
+    bool is_expired( const LogRecordPos &pos ) const {
+        return pos.expire_at != 0 &&
+               pos.expire_at <= clock_ms.load( memory_order_relaxed );
+    }
+
+    // 系统时钟的当前时间 (unix 毫秒)
+    static u64 system_clock_ms();
+
+    // 将带有过期时间的 key 加入时间轮，第一次调用时启动回收线程
+    void track_expiry( const vector< u8 > &key, u64 expire_at );
+
+    // 回收线程，每个 tick 更新时钟并推进时间轮，为到期的 key 分批写入墓碑值
+    void ttl_reap_loop();
+
+    // 为 expired[ begin, end ) 中仍然指向 expire_at 时刻过期记录的 key
+    // 一次追加所有墓碑值
+    void expire_keys( const vector< pair< vector< u8 >, u64 > > &expired,
+                      u64 begin, u64 end );
+
+    // value 是否足够小，可以内联在索引中
+    bool should_inline( const vector< u8 > &value ) const;
+
+    // 读取 entries 中各个位置上的 value，结果与 keys 一一对应。内联或者命中
+    // 缓存的 value 直接返回，其余按位置排序后合并相邻的读取并行发出
+    vector< Result< vector< u8 >, Errors > >
+    read_values( const vector< vector< u8 > >           &keys,
+                 const vector< optional< IndexEntry > > &entries,
+                 const DataFileMap *data_files = nullptr );
+
+    // 遍历迭代器中的数据，data_files 不为空时只从其中读取 value
+    Result< bool, Errors > scan_index(
+        IndexIterator &iter, const DataFileMap *data_files,
+        const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+            &fn );
+
+    // 从数据文件读取之后，将小 value 内联到索引中，其余放入 value 缓存
+    void remember_value( const vector< u8 > &key, const LogRecordPos &pos,
+                         const vector< u8 > &value );
+
+    // 更新内存索引。延迟加载索引期间同时记录 key 最新的序列号，
+    // 之后加载的旧记录不会覆盖前台的写入
+    optional< LogRecordPos > index_put( const vector< u8 > &key,
+                                        const LogRecordPos &pos, u64 seq_no,
+                                        InlineValue value );
+    optional< LogRecordPos > index_del( const vector< u8 > &key, u64 seq_no );
+
+    // 将加载到的一条记录合并到内存索引中，key_seqs 记录每个 key 已经合并的
+    // 最大序列号，只有更新的记录才会生效，同时统计被覆盖的无效数据
+    void apply_loaded_record( unordered_map< string, u64 > &key_seqs,
+                              HintRecord                   &record );
+
+    // 后台线程，按文件 id 从大到小加载 lazy_files 的索引
+    void lazy_load_loop();
+
+    // 加载 lazy_files[ i ] 的索引，其他线程正在加载时等待其完成
+    Result< bool, Errors > load_lazy_file( u64 i );
+
+    // 加载所有可能包含 key 的尚未加载的文件
+    Result< bool, Errors > load_lazy_files_for( const vector< u8 > &key );
+
+    // 等待延迟加载的索引全部加载完成
+    Result< bool, Errors > wait_index_loaded();
+
+    // 位置信息对应的记录被覆盖或删除，计入所在文件的无效数据并标记失效
+    void add_dead_bytes( const LogRecordPos &pos );
+
+    // 记录各活跃文件已经持久化的位置，以及读取上次记录的位置
+    Result< bool, Errors >
+    save_sync_manifest( const vector< pair< u32, u64 > > &durable_offs );
+    unordered_map< u32, u64 > load_sync_manifest();
+
+    // 根据文件 id 找到对应的数据文件，不存在时返回 nullptr
+    shared_ptr< DataFile > find_data_file( u32 file_id ) const;
+
+    // 从数据目录中加载数据文件
+    Result< bool, Errors > load_data_files();
+
+    // 从数据文件中加载内存索引
+    Result< bool, Errors > load_index_from_data_files();
+
+    // 从索引快照中恢复内存索引，返回快照覆盖到的各数据文件的信息，
+    // 快照不存在或者与数据文件不一致时返回空
+    unordered_map< u32, SnapshotFileInfo > load_index_snapshot();
+
+    // 生成索引快照，调用者持有 merge_mutex
+    Result< bool, Errors > write_checkpoint();
+
+    // 后台线程，生成 hint 文件，并每隔 merge_interval_ms 执行一次 merge
+    void background_loop();
+
+    // 交给后台线程为写满的数据文件生成 hint 文件
+    void schedule_hint_file( shared_ptr< DataFile > data_file );
+
+    // 扫描数据文件并生成 hint 文件
+    Result< bool, Errors > generate_hint_file( DataFile &data_file );
+
+    // merge 的一个工作线程: 将 inputs 中的有效记录拷贝到独立的输出文件中
+    Result< bool, Errors >
+    merge_files( const vector< shared_ptr< DataFile > > &inputs,
+                 u64                                     min_outside_seq_no );
+
+    // merge 时打开新的输出文件，并立即对读者可见
+    Result< shared_ptr< DataFile >, Errors > open_merge_file();
+
+    // 替换旧数据文件集合: 移除 removed 中的文件，加入 added 中的文件
+    void replace_older_files( const vector< u32 >                  &removed,
+                              const vector< shared_ptr< DataFile > > &added );
+
+    // merge 完成后移除并删除输入文件，仍被快照引用的文件改名等待快照释放
+    void retire_data_files( const vector< u32 > &removed );
+
+    // 快照释放时减少其数据文件的引用计数，删除不再被引用的已退役文件
+    void unpin_data_files( const DataFileMap &data_files );
+
+    // 配置项
+    Options options;
+
+    // 是否已经成功打开，只有打开成功的实例在析构时才 sync
+    bool opened = false;
+
+    // 当前活跃数据文件
+    vector< unique_ptr< ActiveFile > > active_files;
+
+    // 旧的数据文件，只读，切换活跃文件时整体替换
+    AtomicSharedPtr< const DataFileMap > older_files;
+
+    // 多个活跃文件同时切换时，保护 older_files 的替换
+    mutex older_files_mutex;
+
+    // 内存索引
+    unique_ptr< Indexer > index;
+
+    // 读取数据文件之前的 value 缓存，未开启时为 nullptr
+    unique_ptr< ValueCache > value_cache;
+
+    // 数据库启动时的文件 id，只用于加载索引时使用
+    vector< u32 > file_ids;
+
+    // 下一个新建数据文件的 id
+    atomic< u32 > next_file_id = 0;
+
+    // 全局序列号，每条记录写入时递增
+    atomic< u64 > seq_no = 0;
+
+    // 同一个 key 的写入需要串行化
+    array< mutex, KEY_LOCK_NUM > key_locks;
+
+    // 保证同一时刻只有一个 merge
+    mutex merge_mutex;
+
+    // merge 读写数据的限速器
+    RateLimiter merge_limiter;
+
+    // 粗粒度的当前时间 (unix 毫秒)，由回收线程每个 tick 更新
+    atomic< u64 > clock_ms;
+
+    // 带有过期时间的 key 的时间轮以及回收线程，由 ttl_mutex 保护。
+    // key 被覆盖或删除时不从时间轮中移除，到期时再检查索引
+    mutex                                   ttl_mutex;
+    condition_variable                      ttl_cv;
+    TimerWheel< pair< vector< u8 >, u64 > > ttl_wheel;
+    thread                                  ttl_thread;
+    bool                                    ttl_stop = false;
+
+    // 快照引用的数据文件计数以及 merge 之后等待快照释放的文件，
+    // 创建快照与 merge 删除输入文件由 snapshot_mutex 互斥
+    mutex                     snapshot_mutex;
+    unordered_map< u32, u64 > pinned_files;
+    unordered_set< u32 >      retired_files;
+
+    // 延迟加载索引的状态: 索引是否已经全部加载、尚未加载的旧数据文件
+    // (按文件 id 从大到小) 以及已经加载的每个 key 的最大序列号。
+    // lazy_files 和 lazy_key_seqs 由 lazy_mutex 保护，加载完成后清空
+    atomic< bool >               index_loaded = true;
+    mutex                        lazy_mutex;
+    condition_variable           lazy_cv;
+    vector< LazyFile >           lazy_files;
+    unordered_map< string, u64 > lazy_key_seqs;
+    optional< Errors >           lazy_load_error;
+    thread                       lazy_load_thread;
+    atomic< bool >               lazy_load_stop = false;
+
+    // 后台线程、等待生成 hint 文件的数据文件以及停止信号
+    thread                           background_thread;
+    mutex                            background_mutex;
+    condition_variable               background_cv;
+    vector< shared_ptr< DataFile > > pending_hint_files;
+    bool                             background_stop = false;
+};
+
+// 数据库某一时刻的只读视图，持有引擎的引用，可以在其他线程中长时间使用，
+// 不阻塞前台写入和 merge
+class Snapshot : public Nocopyable {
+  public:
+    ~Snapshot();
+
+    // 根据 key 获取快照时刻对应的数据
+    Result< vector< u8 >, Errors > get( const vector< u8 > &key );
+
+    // 按 options 遍历快照时刻的数据，fn 返回 false 时停止遍历
+    Result< bool, Errors > scan(
+        const IteratorOptions &options,
+        const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+            &fn );
+
+  private:
+    friend class Engine;
+
+    Snapshot( shared_ptr< Engine > engine, unique_ptr< IndexView > index,
+              shared_ptr< const Engine::DataFileMap > data_files );
+
+    shared_ptr< Engine >                    engine;
+    unique_ptr< IndexView >                 index;
+    shared_ptr< const Engine::DataFileMap > data_files;
+};
+
+// 批量写入: put 和 del 只暂存在内存中，commit 时所有记录连续编码，以一条
+// 提交标识结尾，一次追加到同一个活跃文件中。崩溃之后重放时没有提交标识的
+// 批量写入会被丢弃，提交的写入要么全部恢复，要么全部丢弃
+class WriteBatch : public Nocopyable {
+  public:
+    // 暂存写入，同一个 key 只保留最后一次写入
+    Result< bool, Errors > put( const vector< u8 > &key,
+                                const vector< u8 > &value, u64 ttl_ms = 0 );
+
+    // 暂存删除，提交时总是写入墓碑值
+    Result< bool, Errors > del( const vector< u8 > &key );
+
+    // 提交所有暂存的写入，成功之后清空
+    Result< bool, Errors > commit();
+
+  private:
+    friend class Engine;
+
+    WriteBatch( shared_ptr< Engine > engine, const WriteBatchOptions &options );
+
+    shared_ptr< Engine >            engine;
+    WriteBatchOptions               options;
+    mutex                           pending_mutex;
+    map< vector< u8 >, LogRecord > pending_writes;
+};
+
+} // namespace bitcask
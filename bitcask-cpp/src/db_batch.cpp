@@ -0,0 +1,121 @@
+#include "db.h"
+
+namespace bitcask {
+
+// 批量写入的记录在类型字节中带有 LOG_RECORD_BATCH_FLAG，之后紧跟一条
+// TXNFINISHED 提交标识，value 为批量记录的数量。所有记录一次预留、一次写入，
+// 中间不会夹杂其他写者的记录，因此崩溃只可能留下位于文件尾部、缺少提交标识
+// 的批量记录，崩溃恢复时将其截断，见 recover_data_file。
+// 提交标识占用一个记录序号，写入和加载时都直接计入无效数据，merge 时丢弃。
+unique_ptr< WriteBatch >
+Engine::new_write_batch( const WriteBatchOptions &options ) {
+    return unique_ptr< WriteBatch >(
+        new WriteBatch( shared_from_this(), options ) );
+}
+
+Result< bool, Errors > Engine::write_batch( vector< LogRecord > &records,
+                                            bool                 sync ) {
+    // 同时持有所有 key 的锁，序列号的顺序与索引更新的顺序一致
+    vector< mutex * > mutexes;
+    for ( auto &record : records ) {
+        record.in_batch = true;
+        mutexes.push_back( &key_lock( record.key ) );
+    }
+    auto locks = lock_in_order( std::move( mutexes ) );
+
+    LogRecord finished{ {}, {}, LogRecordType::TXNFINISHED };
+    put_varint( finished.value, records.size() );
+    records.push_back( std::move( finished ) );
+
+    // 发布时依次更新索引，墓碑值与提交标识本身都是无效数据
+    auto update_index = [ & ]( u64 i, const LogRecordPos &pos ) {
+        const auto              &record = records[ i ];
+        optional< LogRecordPos > old_pos;
+        if ( record.rec_type == LogRecordType::NORMAL ) {
+            old_pos = index_put( record.key, pos, record.seq_no,
+                                 should_inline( record.value )
+                                     ? InlineValue( record.value )
+                                     : InlineValue() );
+        } else {
+            if ( record.rec_type == LogRecordType::DELETED ) {
+                old_pos = index_del( record.key, record.seq_no );
+            }
+            add_dead_bytes( pos );
+        }
+        if ( old_pos.has_value() ) {
+            add_dead_bytes( *old_pos );
+        }
+        return true;
+    };
+    auto res = append_log_records( records, sync, update_index );
+    records.pop_back();
+    if ( res.is_err() ) {
+        return res;
+    }
+
+    for ( const auto &record : records ) {
+        if ( record.expire_at != 0 ) {
+            track_expiry( record.key, record.expire_at );
+        }
+    }
+    return Ok( true );
+}
+
+WriteBatch::WriteBatch( shared_ptr< Engine >     engine,
+                        const WriteBatchOptions &options )
+    : engine( std::move( engine ) )
+    , options( options ) {
+}
+
+Result< bool, Errors > WriteBatch::put( const vector< u8 > &key,
+                                        const vector< u8 > &value,
+                                        u64                 ttl_ms ) {
+    if ( key.empty() ) {
+        return Err( Errors::KeyIsEmpty );
+    }
+
+    LogRecord record{ key, value, LogRecordType::NORMAL };
+    if ( ttl_ms != 0 ) {
+        record.expire_at = Engine::system_clock_ms() + ttl_ms;
+    }
+
+    lock_guard< mutex > lock( pending_mutex );
+    pending_writes.insert_or_assign( key, std::move( record ) );
+    return Ok( true );
+}
+
+Result< bool, Errors > WriteBatch::del( const vector< u8 > &key ) {
+    if ( key.empty() ) {
+        return Err( Errors::KeyIsEmpty );
+    }
+
+    // 暂存时不判断 key 是否存在: 其他写者可能在提交之前写入该 key
+    lock_guard< mutex > lock( pending_mutex );
+    pending_writes.insert_or_assign(
+        key, LogRecord{ key, {}, LogRecordType::DELETED } );
+    return Ok( true );
+}
+
+Result< bool, Errors > WriteBatch::commit() {
+    lock_guard< mutex > lock( pending_mutex );
+    if ( pending_writes.empty() ) {
+        return Ok( true );
+    }
+    if ( pending_writes.size() > options.max_batch_num ) {
+        return Err( Errors::ExceedMaxBatchNum );
+    }
+
+    vector< LogRecord > records;
+    records.reserve( pending_writes.size() + 1 );
+    for ( auto &[ key, record ] : pending_writes ) {
+        records.push_back( record );
+    }
+    auto res = engine->write_batch(
+        records, options.sync_writes || engine->options.sync_writes );
+    if ( res.is_ok() ) {
+        pending_writes.clear();
+    }
+    return res;
+}
+
+} // namespace bitcask
@@ -0,0 +1,111 @@
+#include "db.h"
+#include "data/hint_file.h"
+#include <filesystem>
+
+namespace bitcask {
+
+// 快照由两部分组成:
+// 1. 索引视图: 创建之后写者在修改 key 之前把旧的位置记录到视图中，
+//    视图读取时优先使用记录下来的旧位置，不需要拷贝整个索引;
+// 2. 数据文件集合: 视图中的位置只会指向创建快照时存在的数据文件，
+//    这些文件的引用计数加一，merge 不会删除仍被引用的文件，
+//    而是改名为 .retired 文件，最后一个引用它的快照释放时再删除。
+// 创建快照与 merge 删除输入文件由 snapshot_mutex 互斥: merge 在删除输入文件
+// 之前已经把索引指向输出文件，之后创建的快照不会再引用输入文件。
+Result< shared_ptr< Snapshot >, Errors > Engine::snapshot() {
+    if ( auto res = wait_index_loaded(); res.is_err() ) {
+        return Err( res.unwrap_err() );
+    }
+
+    lock_guard< mutex > lock( snapshot_mutex );
+    auto                view = index->view();
+
+    // 切换活跃文件时先加入旧数据文件集合再替换槽位，先取活跃文件再取旧数据
+    // 文件，视图创建时存在的文件一定出现在两者之一中
+    auto data_files = make_shared< DataFileMap >();
+    for ( const auto &slot : active_files ) {
+        auto data_file = slot->data_file.load();
+        data_files->emplace( data_file->get_file_id(), std::move( data_file ) );
+    }
+    for ( const auto &[ file_id, data_file ] : *older_files.load() ) {
+        data_files->emplace( file_id, data_file );
+    }
+    for ( const auto &[ file_id, data_file ] : *data_files ) {
+        pinned_files[ file_id ]++;
+    }
+
+    return Ok( shared_ptr< Snapshot >( new Snapshot(
+        shared_from_this(), std::move( view ), std::move( data_files ) ) ) );
+}
+
+void Engine::retire_data_files( const vector< u32 > &removed ) {
+    lock_guard< mutex > lock( snapshot_mutex );
+    replace_older_files( removed, {} );
+    for ( u32 file_id : removed ) {
+        remove_hint_file( options.dir_path, file_id );
+        auto       file_name = DataFile::get_data_file_name( options.dir_path,
+                                                             file_id );
+        error_code ec;
+        if ( pinned_files.count( file_id ) == 0 ) {
+            filesystem::remove( file_name, ec );
+            continue;
+        }
+        // 改名之后重新打开数据库时不会再加载该文件，已打开的文件描述符不受影响
+        filesystem::rename( file_name,
+                            file_name + string( RETIRED_FILE_NAME_SUFFIX ),
+                            ec );
+        retired_files.insert( file_id );
+    }
+}
+
+void Engine::unpin_data_files( const DataFileMap &data_files ) {
+    lock_guard< mutex > lock( snapshot_mutex );
+    for ( const auto &[ file_id, data_file ] : data_files ) {
+        auto iter = pinned_files.find( file_id );
+        if ( --iter->second > 0 ) {
+            continue;
+        }
+        pinned_files.erase( iter );
+        if ( retired_files.erase( file_id ) > 0 ) {
+            error_code ec;
+            filesystem::remove(
+                DataFile::get_data_file_name( options.dir_path, file_id ) +
+                    string( RETIRED_FILE_NAME_SUFFIX ),
+                ec );
+        }
+    }
+}
+
+Snapshot::Snapshot( shared_ptr< Engine > engine, unique_ptr< IndexView > index,
+                    shared_ptr< const Engine::DataFileMap > data_files )
+    : engine( std::move( engine ) )
+    , index( std::move( index ) )
+    , data_files( std::move( data_files ) ) {
+}
+
+Snapshot::~Snapshot() {
+    engine->unpin_data_files( *data_files );
+}
+
+Result< vector< u8 >, Errors > Snapshot::get( const vector< u8 > &key ) {
+    if ( key.empty() ) {
+        return Err( Errors::KeyIsEmpty );
+    }
+    auto entry = index->get_entry( key );
+    if ( !entry.has_value() ) {
+        return Err( Errors::KeyNotFound );
+    }
+    auto values = engine->read_values( { key }, { std::move( entry ) },
+                                       data_files.get() );
+    return std::move( values[ 0 ] );
+}
+
+Result< bool, Errors > Snapshot::scan(
+    const IteratorOptions &options,
+    const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+        &fn ) {
+    auto iter = index->iterator( options );
+    return engine->scan_index( *iter, data_files.get(), fn );
+}
+
+} // namespace bitcask
@@ -0,0 +1,116 @@
+#include "db.h"
+#include <algorithm>
+#include <chrono>
+
+namespace bitcask {
+
+namespace {
+
+// 回收线程每批写入的墓碑值数量，一批墓碑值一次预留、写入和发布，
+// 批与批之间检查停止信号
+constexpr u64 TTL_REAP_BATCH_SIZE = 256;
+
+} // namespace
+
+// 过期时间的处理:
+// 1. 过期时间 (unix 毫秒) 写在记录头部中，加载索引时随位置信息一起恢复，
+//    位置信息中的 expire_at 为 0 表示永不过期;
+// 2. 读取时与回收线程维护的粗粒度时钟比较，过期的 key 视为不存在，
+//    读路径上不需要获取系统时间;
+// 3. 回收线程每个 tick 推进分层时间轮，为到期且索引仍指向该记录的 key
+//    分批写入墓碑值，每批追加到同一段连续的区域中。延迟加载索引完成之前
+//    不推进时间轮，尚未加载的文件中可能有更新的记录;
+// 4. merge 丢弃已经过期、且不会遮挡其他文件中旧记录的数据，见 merge.cpp。
+u64 Engine::system_clock_ms() {
+    return chrono::duration_cast< chrono::milliseconds >(
+               chrono::system_clock::now().time_since_epoch() )
+        .count();
+}
+
+void Engine::track_expiry( const vector< u8 > &key, u64 expire_at ) {
+    lock_guard< mutex > lock( ttl_mutex );
+    if ( ttl_stop ) {
+        return;
+    }
+    if ( !ttl_thread.joinable() ) {
+        ttl_thread = thread( [ this ]() { ttl_reap_loop(); } );
+    }
+    // 向上取整，保证到期时记录一定已经过期
+    u64 tick = ( expire_at + options.ttl_tick_ms - 1 ) / options.ttl_tick_ms;
+    ttl_wheel.add( tick, make_pair( key, expire_at ) );
+}
+
+void Engine::ttl_reap_loop() {
+    unique_lock< mutex > lock( ttl_mutex );
+    while ( !ttl_stop ) {
+        ttl_cv.wait_for( lock, chrono::milliseconds( options.ttl_tick_ms ) );
+        if ( ttl_stop ) {
+            break;
+        }
+        u64 now = system_clock_ms();
+        clock_ms.store( now, memory_order_relaxed );
+        if ( !index_loaded.load( memory_order_acquire ) ) {
+            continue;
+        }
+
+        vector< pair< vector< u8 >, u64 > > expired;
+        ttl_wheel.advance( now / options.ttl_tick_ms, expired );
+        lock.unlock();
+        // 同一个 key 可能以相同的过期时间被加入多次
+        sort( expired.begin(), expired.end() );
+        expired.erase( unique( expired.begin(), expired.end() ),
+                       expired.end() );
+        for ( u64 i = 0; i < expired.size(); i += TTL_REAP_BATCH_SIZE ) {
+            if ( i > 0 ) {
+                lock.lock();
+                bool stop = ttl_stop;
+                lock.unlock();
+                if ( stop ) {
+                    break;
+                }
+            }
+            expire_keys( expired, i,
+                         min( i + TTL_REAP_BATCH_SIZE, expired.size() ) );
+        }
+        lock.lock();
+    }
+}
+
+void Engine::expire_keys( const vector< pair< vector< u8 >, u64 > > &expired,
+                          u64 begin, u64 end ) {
+    // 一次获取这一批 key 对应的锁
+    vector< mutex * > mutexes;
+    for ( u64 i = begin; i < end; i++ ) {
+        mutexes.push_back( &key_lock( expired[ i ].first ) );
+    }
+    auto locks = lock_in_order( std::move( mutexes ) );
+
+    // key 在此期间可能已经被覆盖或删除
+    vector< LogRecord > tombstones;
+    for ( u64 i = begin; i < end; i++ ) {
+        const auto &[ key, expire_at ] = expired[ i ];
+        auto entry                     = index->get_entry( key );
+        if ( entry.has_value() && entry->pos.expire_at == expire_at &&
+             is_expired( entry->pos ) ) {
+            tombstones.push_back(
+                LogRecord{ key, {}, LogRecordType::DELETED } );
+        }
+    }
+    if ( tombstones.empty() ) {
+        return;
+    }
+
+    // 墓碑值写入同一段预留区域，发布时依次删除索引
+    auto update_index = [ & ]( u64 i, const LogRecordPos &pos ) {
+        const auto &record = tombstones[ i ];
+        if ( auto old_pos = index_del( record.key, record.seq_no );
+             old_pos.has_value() ) {
+            add_dead_bytes( *old_pos );
+        }
+        add_dead_bytes( pos );
+        return true;
+    };
+    append_log_records( tombstones, options.sync_writes, update_index );
+}
+
+} // namespace bitcask
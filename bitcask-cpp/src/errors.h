@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string_view>
+
+using namespace std;
+
+namespace bitcask {
+
+// 存储引擎的错误类型
+enum class Errors {
+    FailedToReadFromDataFile,
+    FailedToWriteToDataFile,
+    FailedToSyncDataFile,
+    FailedToOpenDataFile,
+    KeyIsEmpty,
+    KeyNotFound,
+    IndexUpdateFailed,
+    DataFileNotFound,
+    DirPathIsEmpty,
+    DataFileSizeIsInvalid,
+    FailedToCreateDatabaseDir,
+    FailedToReadDatabaseDir,
+    DataDirCorrupted,
+    ReadDataFileEOF,
+    InvalidLogRecordCrc,
+    ActiveFileNumIsInvalid,
+    PartitionNumIsInvalid,
+    PartitionNumMismatch,
+    MergeInProgress,
+    MergeGarbageRatioIsInvalid,
+    HintFileCorrupted,
+    IndexSnapshotCorrupted,
+    InlineValueSizeIsInvalid,
+    TtlTickIsInvalid,
+    ValueIsNotInteger,
+    IntegerOverflow,
+    ExceedMaxBatchNum,
+};
+
+inline string_view error_message( Errors err ) {
+    switch ( err ) {
+    case Errors::FailedToReadFromDataFile:
+        return "failed to read from data file";
+    case Errors::FailedToWriteToDataFile:
+        return "failed to write to data file";
+    case Errors::FailedToSyncDataFile:
+        return "failed to sync data file";
+    case Errors::FailedToOpenDataFile:
+        return "failed to open data file";
+    case Errors::KeyIsEmpty:
+        return "the key is empty";
+    case Errors::KeyNotFound:
+        return "the key is not found in database";
+    case Errors::IndexUpdateFailed:
+        return "memory index failed to update";
+    case Errors::DataFileNotFound:
+        return "the data file is not found in database";
+    case Errors::DirPathIsEmpty:
+        return "the dir path is empty";
+    case Errors::DataFileSizeIsInvalid:
+        return "the data file size is invalid";
+    case Errors::FailedToCreateDatabaseDir:
+        return "failed to create database dir";
+    case Errors::FailedToReadDatabaseDir:
+        return "failed to read database dir";
+    case Errors::DataDirCorrupted:
+        return "database dir maybe corrupted";
+    case Errors::ReadDataFileEOF:
+        return "read data file eof";
+    case Errors::InvalidLogRecordCrc:
+        return "invalid crc value, log record maybe corrupted";
+    case Errors::ActiveFileNumIsInvalid:
+        return "the active file num is invalid";
+    case Errors::PartitionNumIsInvalid:
+        return "the partition num is invalid";
+    case Errors::PartitionNumMismatch:
+        return "the partition num does not match the database dir";
+    case Errors::MergeInProgress:
+        return "merge is in progress, try again later";
+    case Errors::MergeGarbageRatioIsInvalid:
+        return "the merge garbage ratio must be between 0 and 1";
+    case Errors::HintFileCorrupted:
+        return "hint file maybe corrupted";
+    case Errors::IndexSnapshotCorrupted:
+        return "index snapshot maybe corrupted";
+    case Errors::InlineValueSizeIsInvalid:
+        return "the inline value size must not exceed 255";
+    case Errors::TtlTickIsInvalid:
+        return "the ttl tick must be greater than 0";
+    case Errors::ValueIsNotInteger:
+        return "the value is not a decimal integer";
+    case Errors::IntegerOverflow:
+        return "increment would overflow a 64-bit integer";
+    case Errors::ExceedMaxBatchNum:
+        return "exceed the max batch num";
+    }
+    return "unknown error";
+}
+
+} // namespace bitcask
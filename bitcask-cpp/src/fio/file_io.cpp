@@ -1,55 +1,165 @@
 #include "file_io.h"
 #include <cstddef>
 #include <cstdio>
-#include <mutex>
-#include <shared_mutex>
+#include <fcntl.h>
 #include <vector>
 
-/// TODO: 使用File类进行重构，尽可能的简洁
-namespace bitcask {
-
-u64 FileIO::read( vector< u8 > &buf, u64 offset ) {
-    shared_lock< shared_mutex > ReadLock( this->mutex );
-
-    // 获取文件大小
-    auto original_position = file->tellg();
-    file->seekg( 0, file->end );
-    u64 file_size = file->tellg();
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
-    file->seekg( original_position );
+namespace bitcask {
 
-    cout << file_size << endl;
-    // 判断读取数据的大小
-    if ( offset >= file_size ) {
-        return 0;
-    }
-    u64 read_size = 0;
-    if ( file_size - offset < buf.size() ) {
-        read_size = file_size - offset;
-    } else {
-        read_size = buf.size();
+FileIO::FileIO( const string &file_path ) {
+    // 不使用 O_APPEND，否则 Linux 下 pwrite 会忽略偏移直接追加
+#ifdef _WIN32
+    fd = ::_open( file_path.c_str(), _O_CREAT | _O_RDWR | _O_BINARY, 0644 );
+    auto size = fd < 0 ? -1 : ::_lseeki64( fd, 0, SEEK_END );
+#else
+    fd        = ::open( file_path.c_str(), O_CREAT | O_RDWR, 0644 );
+    auto size = fd < 0 ? -1 : ::lseek( fd, 0, SEEK_END );
+#endif
+    if ( fd < 0 || size < 0 ) {
+        close();
+        throw runtime_error( "Failed to open file" );
     }
-    cout << read_size << endl;
+    append_off = static_cast< u64 >( size );
+}
 
-    this->file->seekg( file->beg + offset );
-    if ( !this->file->read( reinterpret_cast< char * >( buf.data() ),
-                            read_size ) ) {
+u64 FileIO::read( vector< u8 > &buf, u64 offset ) {
+    u64 read_size = 0;
+#ifdef _WIN32
+    lock_guard< std::mutex > lock( this->mutex );
+    if ( ::_lseeki64( fd, offset, SEEK_SET ) < 0 ) {
         throw runtime_error( "Failed to read file" );
     }
+#endif
+    // 循环读取直到读满 buf 或者读到文件末尾
+    while ( read_size < buf.size() ) {
+#ifdef _WIN32
+        auto n = ::_read( fd, buf.data() + read_size,
+                          static_cast< unsigned >( buf.size() - read_size ) );
+#else
+        auto n = ::pread( fd, buf.data() + read_size, buf.size() - read_size,
+                          offset + read_size );
+#endif
+        if ( n < 0 ) {
+            throw runtime_error( "Failed to read file" );
+        }
+        if ( n == 0 ) {
+            break;
+        }
+        read_size += n;
+    }
     return read_size;
 }
 
 u64 FileIO::write( vector< u8 > &buf ) {
-    unique_lock< shared_mutex > WriteLock( this->mutex );
+    // 先预留出写入的区域，再按偏移写入
+    u64 offset = append_off.fetch_add( buf.size() );
+    return write_at( buf, offset );
+}
 
-    if ( !this->file->write( reinterpret_cast< char * >( buf.data() ),
-                             buf.size() ) ) {
+u64 FileIO::write_at( vector< u8 > &buf, u64 offset ) {
+    u64 write_size = 0;
+#ifdef _WIN32
+    lock_guard< std::mutex > lock( this->mutex );
+    if ( ::_lseeki64( fd, offset, SEEK_SET ) < 0 ) {
         throw runtime_error( "Failed to write file" );
     }
-    return buf.size();
+#endif
+    while ( write_size < buf.size() ) {
+#ifdef _WIN32
+        auto n = ::_write( fd, buf.data() + write_size,
+                           static_cast< unsigned >( buf.size() - write_size ) );
+#else
+        auto n = ::pwrite( fd, buf.data() + write_size,
+                           buf.size() - write_size, offset + write_size );
+#endif
+        if ( n < 0 ) {
+            throw runtime_error( "Failed to write file" );
+        }
+        write_size += n;
+    }
+
+    advance_append_off( offset + write_size );
+    return write_size;
+}
+
+u64 FileIO::copy_from( IOManager &src, u64 src_offset, u64 len,
+                       u64 dst_offset, bool zero_copy ) {
+#ifdef __linux__
+    auto *src_file = dynamic_cast< FileIO * >( &src );
+    if ( zero_copy && src_file != nullptr ) {
+        u64 copied = 0;
+        while ( copied < len ) {
+            loff_t in_off  = static_cast< loff_t >( src_offset + copied );
+            loff_t out_off = static_cast< loff_t >( dst_offset + copied );
+            auto   n = ::copy_file_range( src_file->fd, &in_off, fd, &out_off,
+                                          len - copied, 0 );
+            // 跨文件系统 (EXDEV)、内核不支持 (ENOSYS) 等情况下返回 -1
+            if ( n <= 0 ) {
+                break;
+            }
+            copied += n;
+        }
+        advance_append_off( dst_offset + copied );
+        if ( copied == len ) {
+            return copied;
+        }
+        return copied + IOManager::copy_from( src, src_offset + copied,
+                                              len - copied,
+                                              dst_offset + copied, false );
+    }
+#endif
+    return IOManager::copy_from( src, src_offset, len, dst_offset, zero_copy );
+}
+
+void FileIO::advance_append_off( u64 end ) {
+    u64 current = append_off.load();
+    while ( current < end &&
+            !append_off.compare_exchange_weak( current, end ) ) {
+    }
 }
 
 void FileIO::sync() {
+#ifdef _WIN32
+    auto res = ::_commit( fd );
+#else
+    auto res = ::fsync( fd );
+#endif
+    if ( res != 0 ) {
+        throw runtime_error( "Failed to sync file" );
+    }
+}
+
+void FileIO::truncate( u64 size ) {
+#ifdef _WIN32
+    auto res = ::_chsize_s( fd, static_cast< __int64 >( size ) );
+#else
+    auto res = ::ftruncate( fd, static_cast< off_t >( size ) );
+#endif
+    if ( res != 0 ) {
+        throw runtime_error( "Failed to truncate file" );
+    }
+    append_off = size;
+}
+
+u64 FileIO::size() const {
+    return append_off.load();
+}
+
+void FileIO::close() {
+    if ( fd >= 0 ) {
+#ifdef _WIN32
+        ::_close( fd );
+#else
+        ::close( fd );
+#endif
+        fd = -1;
+    }
 }
 
 } // namespace bitcask
@@ -2,10 +2,11 @@
 #include "../data/data_file.h"
 #include "../utils/IOManager.h"
 #include "../utils/type.h"
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <memory>
-#include <shared_mutex>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -13,30 +14,41 @@ using namespace std;
 
 namespace bitcask {
 
+// FileIO 标准系统文件 IO
+// 读写都使用 pread/pwrite 按偏移进行，不依赖文件指针，多个线程可以无锁并发读写
+// 互不重叠的区域; write 通过原子地推进 append_off 实现追加写。
 class FileIO : public IOManager {
   public:
-    FileIO( string &file_path ) {
-        file = make_shared< fstream >( file_path, fstream::in | fstream::out |
-                                                      fstream::binary |
-                                                      fstream::app );
-        if ( !*file ) {
-            throw runtime_error( "Failed to open file" );
-        }
-    }
+    FileIO( const string &file_path );
     ~FileIO() {
         close();
     }
 
     u64  read( vector< u8 > &buf, u64 offset ) override;
     u64  write( vector< u8 > &buf ) override;
-    void close() {
-        file->close();
-    }
+    u64  write_at( vector< u8 > &buf, u64 offset ) override;
+    void close();
     void sync() override;
+    void truncate( u64 size ) override;
+    u64  size() const override;
+    // Linux 下优先使用 copy_file_range，支持 reflink 的文件系统 (XFS、btrfs)
+    // 上甚至不需要拷贝数据，失败时退回到缓冲区拷贝
+    u64  copy_from( IOManager &src, u64 src_offset, u64 len, u64 dst_offset,
+                    bool zero_copy ) override;
 
   private:
-    shared_mutex          mutex;
-    shared_ptr< fstream > file;
+    // 保证 append_off 不落后于已写入的位置
+    void advance_append_off( u64 end );
+
+    // 系统文件描述符
+    int fd = -1;
+
+    // 追加写的位置，打开文件时为文件大小
+    atomic< u64 > append_off = 0;
+#ifdef _WIN32
+    // Windows 下没有 pread/pwrite，读写需要互斥地移动文件指针
+    mutex mutex;
+#endif
 };
 
-} // namespace bitcask
\ No newline at end of file
+} // namespace bitcask
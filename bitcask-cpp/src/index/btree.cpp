@@ -1,32 +1,428 @@
 #include "btree.h"
+#include <algorithm>
+#include <cstring>
 #include <mutex>
-#include <shared_mutex>
 
 namespace bitcask {
 
-bool BTree::put( vector< u8 > key, LogRecordPos pos ) {
+namespace {
+
+// 批量查询时从上一个结果向后移动迭代器的最大步数，超过之后从根节点重新查找
+constexpr int MULTI_GET_MAX_STEPS = 8;
+
+// 迭代器每次持有读锁拷贝的数据条数
+constexpr u64 ITERATOR_BATCH_SIZE = 256;
+
+// 大于所有以 prefix 开头的 key 的最小 key，prefix 全为 0xff 时不存在
+optional< vector< u8 > > prefix_successor( vector< u8 > prefix ) {
+    while ( !prefix.empty() && prefix.back() == 0xff ) {
+        prefix.pop_back();
+    }
+    if ( prefix.empty() ) {
+        return nullopt;
+    }
+    prefix.back()++;
+    return prefix;
+}
+
+} // namespace
+
+// 按方向遍历 map 中 [lower, upper) 范围内元素的游标。
+// 反向遍历时 iter 指向当前元素的下一个位置
+template < typename Map > class MapCursor {
+  public:
+    // 从 start 开始遍历，inclusive 表示是否包含 start 本身，
+    // start 为空或者超出范围时从遍历的起点开始
+    MapCursor( Map &map, bool reverse, const optional< vector< u8 > > &start,
+               bool inclusive, const optional< vector< u8 > > &lower,
+               const optional< vector< u8 > > &upper )
+        : map( map )
+        , reverse( reverse )
+        , lower( lower )
+        , upper( upper ) {
+        if ( !reverse ) {
+            iter = map.begin();
+            if ( start.has_value() &&
+                 ( !lower.has_value() || !( *start < *lower ) ) ) {
+                iter = inclusive ? map.lower_bound( *start )
+                                 : map.upper_bound( *start );
+            } else if ( lower.has_value() ) {
+                iter = map.lower_bound( *lower );
+            }
+        } else {
+            iter = map.end();
+            if ( start.has_value() &&
+                 ( !upper.has_value() || *start < *upper ) ) {
+                iter = inclusive ? map.upper_bound( *start )
+                                 : map.lower_bound( *start );
+            } else if ( upper.has_value() ) {
+                iter = map.lower_bound( *upper );
+            }
+        }
+    }
+
+    bool valid() const {
+        if ( !reverse ) {
+            return iter != map.end() &&
+                   ( !upper.has_value() || iter->first < *upper );
+        }
+        return iter != map.begin() &&
+               ( !lower.has_value() || !( prev( iter )->first < *lower ) );
+    }
+
+    // 当前元素，只能在 valid() 时调用
+    auto current() const {
+        return reverse ? prev( iter ) : iter;
+    }
+
+    void next() {
+        if ( reverse ) {
+            --iter;
+        } else {
+            ++iter;
+        }
+    }
+
+  private:
+    // 非 const 的 map 是 iterator，const 的 map 是 const_iterator
+    using Iter = decltype( declval< Map & >().begin() );
+
+    Map                            &map;
+    bool                            reverse;
+    const optional< vector< u8 > > &lower;
+    const optional< vector< u8 > > &upper;
+    Iter                            iter;
+};
+
+// BTree 的迭代器，每次在读锁内拷贝一批数据，用完之后从最后一个 key 继续拷贝。
+// 遍历快照时将索引与快照记录的修改之前的内容合并，同一个 key 以后者为准
+class BTree::Iterator : public IndexIterator {
+  public:
+    Iterator( BTree &btree, const IteratorOptions &options,
+              const UndoLog *undo = nullptr )
+        : btree( btree )
+        , undo( undo )
+        , lower( options.lower_bound )
+        , upper( options.upper_bound )
+        , reverse( options.reverse ) {
+        // 前缀换算为范围 [prefix, prefix_successor)，与指定的范围取交集
+        if ( !options.prefix.empty() ) {
+            if ( !lower.has_value() || *lower < options.prefix ) {
+                lower = options.prefix;
+            }
+            auto prefix_end = prefix_successor( options.prefix );
+            if ( prefix_end.has_value() &&
+                 ( !upper.has_value() || *prefix_end < *upper ) ) {
+                upper = std::move( prefix_end );
+            }
+        }
+        rewind();
+    }
+
+    void rewind() override {
+        fill( nullopt, true );
+    }
+
+    void seek( const vector< u8 > &key ) override {
+        fill( key, true );
+    }
+
+    void next() override {
+        if ( ++index == batch.size() && !exhausted ) {
+            fill( batch.back().first, false );
+        }
+    }
+
+    bool valid() const override {
+        return index < batch.size();
+    }
+
+    const vector< u8 > &key() const override {
+        return batch[ index ].first;
+    }
+
+    const IndexEntry &entry() const override {
+        return batch[ index ].second;
+    }
+
+  private:
+    // 从 start 开始拷贝下一批数据，参数的含义与 MapCursor 相同
+    void fill( const optional< vector< u8 > > &start, bool inclusive ) {
+        vector< pair< vector< u8 >, IndexEntry > > next_batch;
+        next_batch.reserve( ITERATOR_BATCH_SIZE );
+
+        // 读锁，共享
+        shared_lock< ScalableSharedMutex > Rlock( btree.RWLock );
+        MapCursor tree_cursor( *btree.tree, reverse, start, inclusive, lower,
+                               upper );
+        UndoLog   empty;
+        MapCursor undo_cursor( undo != nullptr ? *undo : empty, reverse, start,
+                               inclusive, lower, upper );
+        // a 在遍历方向上是否排在 b 之前
+        auto before = [ & ]( const vector< u8 > &a, const vector< u8 > &b ) {
+            return reverse ? b < a : a < b;
+        };
+
+        while ( next_batch.size() < ITERATOR_BATCH_SIZE ) {
+            bool tree_valid = tree_cursor.valid();
+            bool undo_valid = undo_cursor.valid();
+            if ( !tree_valid && !undo_valid ) {
+                break;
+            }
+            if ( undo_valid &&
+                 ( !tree_valid || !before( tree_cursor.current()->first,
+                                           undo_cursor.current()->first ) ) ) {
+                // 快照创建之后被修改过的 key，使用修改之前的内容
+                auto saved = undo_cursor.current();
+                if ( tree_valid &&
+                     tree_cursor.current()->first == saved->first ) {
+                    tree_cursor.next();
+                }
+                if ( saved->second.has_value() ) {
+                    next_batch.emplace_back( saved->first, *saved->second );
+                }
+                undo_cursor.next();
+            } else {
+                auto entry = tree_cursor.current();
+                next_batch.emplace_back( entry->first, entry->second );
+                tree_cursor.next();
+            }
+        }
+
+        exhausted = next_batch.size() < ITERATOR_BATCH_SIZE;
+        batch     = std::move( next_batch );
+        index     = 0;
+    }
+
+    BTree                                     &btree;
+    const UndoLog                             *undo;
+    optional< vector< u8 > >                   lower;
+    optional< vector< u8 > >                   upper;
+    bool                                       reverse;
+    vector< pair< vector< u8 >, IndexEntry > > batch;
+    u64                                        index     = 0;
+    bool                                       exhausted = false;
+};
+
+// BTree 的只读视图。创建时在索引中登记一份修改记录，之后索引中的 key 第一次
+// 被修改或删除之前，会把原来的内容记录下来，读取时优先使用记录的内容
+class BTree::View : public IndexView {
+  public:
+    explicit View( BTree &btree )
+        : btree( btree ) {
+        // 写锁，独占
+        unique_lock< ScalableSharedMutex > Wlock( btree.RWLock );
+        btree.undo_logs.push_back( &undo );
+    }
+
+    ~View() override {
+        // 写锁，独占
+        unique_lock< ScalableSharedMutex > Wlock( btree.RWLock );
+        auto &logs = btree.undo_logs;
+        logs.erase( find( logs.begin(), logs.end(), &undo ) );
+    }
+
+    optional< IndexEntry > get_entry( const vector< u8 > &key ) override {
+        // 读锁，共享
+        shared_lock< ScalableSharedMutex > Rlock( btree.RWLock );
+        if ( auto iter = undo.find( key ); iter != undo.end() ) {
+            return iter->second;
+        }
+        auto iter = btree.tree->find( key );
+        if ( iter == btree.tree->end() ) {
+            return nullopt;
+        }
+        return iter->second;
+    }
+
+    unique_ptr< IndexIterator >
+    iterator( const IteratorOptions &options ) override {
+        return make_unique< Iterator >( btree, options, &undo );
+    }
+
+  private:
+    BTree  &btree;
+    UndoLog undo;
+};
+
+InlineValue::InlineValue( const vector< u8 > &value )
+    : data( make_unique< u8[] >( value.size() + 1 ) ) {
+    data[ 0 ] = static_cast< u8 >( value.size() );
+    copy( value.begin(), value.end(), data.get() + 1 );
+}
+
+InlineValue::InlineValue( const InlineValue &other ) {
+    if ( other.data != nullptr ) {
+        data = make_unique< u8[] >( other.memory_usage() );
+        memcpy( data.get(), other.data.get(), other.memory_usage() );
+    }
+}
+
+vector< u8 > InlineValue::value() const {
+    if ( data == nullptr ) {
+        return {};
+    }
+    return vector< u8 >( data.get() + 1, data.get() + 1 + data[ 0 ] );
+}
+
+optional< LogRecordPos > BTree::put( vector< u8 > key, LogRecordPos pos,
+                                     InlineValue value ) {
+    // 写锁，独占
+    unique_lock< ScalableSharedMutex > Wlock( RWLock );
+    inline_bytes += value.memory_usage();
+
+    // 一次查找完成插入或原地覆盖: key 已存在时 try_emplace 不会移动参数
+    auto [ iter, inserted ] =
+        tree->try_emplace( std::move( key ), pos, std::move( value ) );
+    if ( inserted ) {
+        save_undo( iter->first, nullptr );
+        return nullopt;
+    }
+    save_undo( iter->first, &iter->second );
+    auto old_pos        = iter->second.pos;
+    inline_bytes       -= iter->second.value.memory_usage();
+    iter->second.pos    = pos;
+    iter->second.value  = std::move( value );
+    return old_pos;
+}
+
+optional< LogRecordPos > BTree::get( vector< u8 > key ) {
+    // 读锁，共享
+    shared_lock< ScalableSharedMutex > Rlock( RWLock );
+    auto                               iter = tree->find( key );
+    if ( iter == tree->end() ) {
+        return nullopt;
+    }
+    return iter->second.pos;
+}
+
+optional< IndexEntry > BTree::get_entry( vector< u8 > key ) {
+    // 读锁，共享
+    shared_lock< ScalableSharedMutex > Rlock( RWLock );
+    auto                               iter = tree->find( key );
+    if ( iter == tree->end() ) {
+        return nullopt;
+    }
+    return iter->second;
+}
+
+vector< optional< IndexEntry > >
+BTree::multi_get( const vector< vector< u8 > > &keys ) {
+    // 按 key 的顺序查找，相邻的 key 共享树的上层节点，
+    // 距离上一个结果很近的 key 直接向后移动迭代器，不必从根节点重新查找
+    vector< u64 > order( keys.size() );
+    for ( u64 i = 0; i < keys.size(); i++ ) {
+        order[ i ] = i;
+    }
+    sort( order.begin(), order.end(),
+          [ & ]( u64 a, u64 b ) { return keys[ a ] < keys[ b ]; } );
+
+    vector< optional< IndexEntry > > entries( keys.size() );
+    // 读锁，共享
+    shared_lock< ScalableSharedMutex > Rlock( RWLock );
+    auto                               iter = tree->end();
+    for ( u64 i : order ) {
+        const auto &key = keys[ i ];
+        for ( int step = 0; step < MULTI_GET_MAX_STEPS; step++ ) {
+            if ( iter == tree->end() || !( iter->first < key ) ) {
+                break;
+            }
+            ++iter;
+        }
+        // 迭代器从上一个 key 的 lower_bound 开始只跳过了小于 key 的节点，
+        // 停下的位置就是 key 的 lower_bound
+        if ( iter == tree->end() || iter->first < key ) {
+            iter = tree->lower_bound( key );
+        }
+        if ( iter != tree->end() && iter->first == key ) {
+            entries[ i ] = iter->second;
+        }
+    }
+    return entries;
+}
+
+bool BTree::set_inline_value( vector< u8 > key, LogRecordPos pos,
+                              InlineValue value ) {
     // 写锁，独占
-    unique_lock< shared_mutex > Wlock( RWLock );
-    auto                        result = tree->insert( { key, pos } );
-    return result.second;
+    unique_lock< ScalableSharedMutex > Wlock( RWLock );
+    auto                               iter = tree->find( key );
+    if ( iter == tree->end() || !( iter->second.pos == pos ) ) {
+        return false;
+    }
+    inline_bytes       -= iter->second.value.memory_usage();
+    inline_bytes       += value.memory_usage();
+    iter->second.value  = std::move( value );
+    return true;
 }
 
-LogRecordPos BTree::get( vector< u8 > key ) {
+u64 BTree::inline_value_bytes() {
     // 读锁，共享
-    shared_lock< shared_mutex > Rlock( RWLock );
-    auto                        result = tree->at( key );
+    shared_lock< ScalableSharedMutex > Rlock( RWLock );
+    return inline_bytes;
+}
 
-    return result;
+optional< LogRecordPos > BTree::del( vector< u8 > key ) {
+    // 写锁，独占
+    unique_lock< ScalableSharedMutex > Wlock( RWLock );
+    auto                               iter = tree->find( key );
+    if ( iter == tree->end() ) {
+        return nullopt;
+    }
+    save_undo( key, &iter->second );
+    auto old_pos  = iter->second.pos;
+    inline_bytes -= iter->second.value.memory_usage();
+    tree->erase( iter );
+    return old_pos;
+}
+
+vector< vector< u8 > > BTree::list_keys() {
+    // 读锁，共享
+    shared_lock< ScalableSharedMutex > Rlock( RWLock );
+    vector< vector< u8 > >             keys;
+    keys.reserve( tree->size() );
+    for ( const auto &[ key, pos ] : *tree ) {
+        keys.push_back( key );
+    }
+    return keys;
 }
 
-bool BTree::del( vector< u8 > key ) {
+vector< pair< vector< u8 >, LogRecordPos > > BTree::list_entries() {
     // 读锁，共享
-    shared_lock< shared_mutex > Rlock( RWLock );
-    auto                        iter = tree->find( key );
-    if ( iter != tree->end() ) {
-        tree->erase( iter );
-        return true;
+    shared_lock< ScalableSharedMutex > Rlock( RWLock );
+    vector< pair< vector< u8 >, LogRecordPos > > entries;
+    entries.reserve( tree->size() );
+    for ( const auto &[ key, entry ] : *tree ) {
+        entries.emplace_back( key, entry.pos );
+    }
+    return entries;
+}
+
+unique_ptr< IndexIterator >
+BTree::iterator( const IteratorOptions &options ) {
+    return make_unique< Iterator >( *this, options );
+}
+
+unique_ptr< IndexView > BTree::view() {
+    return make_unique< View >( *this );
+}
+
+void BTree::save_undo( const vector< u8 > &key, const IndexEntry *old ) {
+    for ( auto *undo : undo_logs ) {
+        if ( undo->find( key ) == undo->end() ) {
+            undo->emplace( key, old != nullptr ? optional< IndexEntry >( *old )
+                                               : nullopt );
+        }
+    }
+}
+
+void BTree::bulk_load( vector< pair< vector< u8 >, LogRecordPos > > entries ) {
+    // 写锁，独占
+    unique_lock< ScalableSharedMutex > Wlock( RWLock );
+    // 数据有序时每次都插入到末尾，以 end() 作为提示，插入为均摊常数时间
+    // 快照中不包含内联的 value，之后第一次读取时再内联
+    for ( auto &[ key, pos ] : entries ) {
+        tree->insert_or_assign( tree->end(), std::move( key ),
+                                IndexEntry{ pos, InlineValue() } );
     }
-    return false;
 }
 } // namespace bitcask
\ No newline at end of file
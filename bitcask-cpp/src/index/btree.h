@@ -1,36 +1,180 @@
 #pragma once
 #include "../data/log_record.h"
+#include "../options.h"
+#include "../utils/RwLock.h"
 #include "../utils/type.h"
 #include <cstdint>
 #include <map>
 #include <memory>
-#include <shared_mutex>
+#include <optional>
+#include <utility>
 #include <vector>
 using namespace std;
 
 namespace bitcask {
 
+// 内联在索引中的小 value，首字节为长度，之后是 value 的内容。
+// 没有内联时只占用一个空指针的空间
+class InlineValue {
+  public:
+    // 可以内联的 value 的最大长度
+    static constexpr u64 MAX_SIZE = 255;
+
+    InlineValue() = default;
+    explicit InlineValue( const vector< u8 > &value );
+    InlineValue( const InlineValue &other );
+    InlineValue( InlineValue &&other ) = default;
+    InlineValue &operator=( InlineValue other ) {
+        data.swap( other.data );
+        return *this;
+    }
+
+    bool has_value() const {
+        return data != nullptr;
+    }
+
+    vector< u8 > value() const;
+
+    // 内联的 value 额外占用的堆内存字节数
+    u64 memory_usage() const {
+        return data == nullptr ? 0 : data[ 0 ] + 1;
+    }
+
+  private:
+    unique_ptr< u8[] > data;
+};
+
+// 索引中 key 对应的内容: 数据位置以及可能内联的 value
+struct IndexEntry {
+    LogRecordPos pos;
+    InlineValue  value;
+};
+
+// 索引的有序迭代器。创建之后索引仍然可以并发修改，迭代器每次从索引中
+// 拷贝一小批数据，不会长时间持有索引的锁，也不会看到写了一半的状态
+class IndexIterator {
+  public:
+    virtual ~IndexIterator() = default;
+
+    // 回到遍历的起点
+    virtual void rewind() = 0;
+
+    // 正向遍历时定位到第一个大于等于 key 的位置，
+    // 反向遍历时定位到第一个小于等于 key 的位置
+    virtual void seek( const vector< u8 > &key ) = 0;
+
+    // 移动到下一个位置
+    virtual void next() = 0;
+
+    // 是否还有数据，为 false 时遍历结束
+    virtual bool valid() const = 0;
+
+    // 当前位置的 key 以及位置信息，只能在 valid() 时调用
+    virtual const vector< u8 > &key() const   = 0;
+    virtual const IndexEntry   &entry() const = 0;
+};
+
+// 索引某一时刻的只读视图，创建之后索引上的修改不会影响视图中的内容
+class IndexView {
+  public:
+    virtual ~IndexView() = default;
+
+    // 根据 key 取出视图创建时的位置信息，不存在时返回 nullopt
+    virtual optional< IndexEntry > get_entry( const vector< u8 > &key ) = 0;
+
+    // 按 options 指定的范围和方向遍历视图中的数据
+    virtual unique_ptr< IndexIterator >
+    iterator( const IteratorOptions &options ) = 0;
+};
+
 class Indexer {
   public:
     virtual ~Indexer() = default;
 
-    virtual bool         put( vector< u8 > key, LogRecordPos pos ) = 0;
-    virtual LogRecordPos get( vector< u8 > key )                   = 0;
-    virtual bool         del( vector< u8 > key )                   = 0;
+    // 存储 key 对应的数据位置信息以及内联的 value，只查找一次。
+    // key 已存在时原地覆盖并返回旧的位置信息，调用方据此统计无效数据
+    virtual optional< LogRecordPos >
+    put( vector< u8 > key, LogRecordPos pos,
+         InlineValue value = InlineValue() ) = 0;
+
+    // 根据 key 取出对应的索引位置信息，不存在时返回 nullopt
+    virtual optional< LogRecordPos > get( vector< u8 > key ) = 0;
+
+    // 根据 key 取出位置信息以及内联的 value，不存在时返回 nullopt
+    virtual optional< IndexEntry > get_entry( vector< u8 > key ) = 0;
+
+    // 批量取出多个 key 的位置信息以及内联的 value，结果与 keys 一一对应
+    virtual vector< optional< IndexEntry > >
+    multi_get( const vector< vector< u8 > > &keys ) = 0;
+
+    // key 仍然指向 pos 时为其内联 value，返回是否成功
+    virtual bool set_inline_value( vector< u8 > key, LogRecordPos pos,
+                                   InlineValue value ) = 0;
+
+    // 所有内联的 value 占用的堆内存字节数
+    virtual u64 inline_value_bytes() = 0;
+
+    // 删除 key 对应的索引位置信息，返回被删除的位置信息，不存在时返回 nullopt
+    virtual optional< LogRecordPos > del( vector< u8 > key ) = 0;
+
+    // 按顺序返回索引中所有的 key
+    virtual vector< vector< u8 > > list_keys() = 0;
+
+    // 按 key 的顺序返回索引中所有的 key 及其位置信息
+    virtual vector< pair< vector< u8 >, LogRecordPos > > list_entries() = 0;
+
+    // 按 options 指定的范围和方向创建迭代器，迭代器不能比索引活得更久
+    virtual unique_ptr< IndexIterator >
+    iterator( const IteratorOptions &options ) = 0;
+
+    // 创建索引当前的只读视图，视图不能比索引活得更久
+    virtual unique_ptr< IndexView > view() = 0;
+
+    // 批量加载按 key 有序的数据，用于从索引快照中恢复
+    virtual void
+    bulk_load( vector< pair< vector< u8 >, LogRecordPos > > entries ) = 0;
 };
 class BTree : public Indexer {
   public:
     BTree()
-        : tree( make_shared< map< vector< u8 >, LogRecordPos > >() ) {
+        : tree( make_shared< map< vector< u8 >, IndexEntry > >() ) {
     }
 
-    bool         put( vector< u8 > key, LogRecordPos pos ) override;
-    LogRecordPos get( vector< u8 > key ) override;
-    bool         del( vector< u8 > key ) override;
+    optional< LogRecordPos > put( vector< u8 > key, LogRecordPos pos,
+                                  InlineValue value = InlineValue() ) override;
+    optional< LogRecordPos > get( vector< u8 > key ) override;
+    optional< IndexEntry >   get_entry( vector< u8 > key ) override;
+    vector< optional< IndexEntry > >
+         multi_get( const vector< vector< u8 > > &keys ) override;
+    bool set_inline_value( vector< u8 > key, LogRecordPos pos,
+                           InlineValue value ) override;
+    u64  inline_value_bytes() override;
+    optional< LogRecordPos > del( vector< u8 > key ) override;
+    vector< vector< u8 > >   list_keys() override;
+
+    vector< pair< vector< u8 >, LogRecordPos > > list_entries() override;
+    unique_ptr< IndexIterator >
+    iterator( const IteratorOptions &options ) override;
+    unique_ptr< IndexView > view() override;
+    void
+    bulk_load( vector< pair< vector< u8 >, LogRecordPos > > entries ) override;
 
   private:
-    shared_ptr< map< vector< u8 >, LogRecordPos > > tree;
-    shared_mutex                                    RWLock;
+    class Iterator;
+    class View;
+
+    // 视图创建之后被修改的 key 在修改之前的内容，创建时不存在的 key 为 nullopt
+    using UndoLog = map< vector< u8 >, optional< IndexEntry > >;
+
+    // 修改 key 之前，为每个存活的视图记录 key 原来的内容，old 为空表示不存在
+    void save_undo( const vector< u8 > &key, const IndexEntry *old );
+
+    shared_ptr< map< vector< u8 >, IndexEntry > > tree;
+    ScalableSharedMutex                           RWLock;
+    // 内联的 value 占用的堆内存，由 RWLock 保护
+    u64 inline_bytes = 0;
+    // 所有存活的视图的修改记录，由 RWLock 保护
+    vector< UndoLog * > undo_logs;
 };
 
 } // namespace bitcask
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "snapshot.h"
+#include "../fio/file_io.h"
+#include "../utils/crc32.h"
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace bitcask {
+
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[ 8 ] = { 'B', 'C', 'I', 'D', 'X', 'S', 'N', '3' };
+
+// 每次写入文件的缓冲区大小
+constexpr u64 SNAPSHOT_WRITE_BUFFER_SIZE = 1024 * 1024;
+
+template < typename T > void put_fixed( vector< u8 > &buf, T value ) {
+    for ( u64 i = 0; i < sizeof( T ); i++ ) {
+        buf.push_back( static_cast< u8 >( value >> ( 8 * i ) ) );
+    }
+}
+
+// 顺序解析映射到内存中的快照内容
+class SnapshotReader {
+  public:
+    SnapshotReader( const u8 *data, u64 size )
+        : data( data )
+        , size( size ) {
+    }
+
+    template < typename T > bool get_fixed( T &value ) {
+        if ( size - index < sizeof( T ) ) {
+            return false;
+        }
+        value = 0;
+        for ( u64 i = 0; i < sizeof( T ); i++ ) {
+            value |= static_cast< T >( data[ index + i ] ) << ( 8 * i );
+        }
+        index += sizeof( T );
+        return true;
+    }
+
+    bool get_bytes( vector< u8 > &buf, u64 len ) {
+        if ( size - index < len ) {
+            return false;
+        }
+        buf.assign( data + index, data + index + len );
+        index += len;
+        return true;
+    }
+
+  private:
+    const u8 *data;
+    u64       size;
+    u64       index = 0;
+};
+
+// 只读映射整个文件，析构时解除映射
+class MappedFile {
+  public:
+    explicit MappedFile( const string &path ) {
+#ifdef _WIN32
+        ifstream in( path, ios::binary );
+        buf.assign( istreambuf_iterator< char >( in ),
+                    istreambuf_iterator< char >() );
+        data = buf.data();
+        size = buf.size();
+        ok   = in.good() || in.eof();
+#else
+        int fd = ::open( path.c_str(), O_RDONLY );
+        if ( fd < 0 ) {
+            return;
+        }
+        off_t len = ::lseek( fd, 0, SEEK_END );
+        if ( len > 0 ) {
+            void *addr = ::mmap( nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( addr != MAP_FAILED ) {
+                // 顺序解析，提示内核提前预读
+                ::madvise( addr, len, MADV_SEQUENTIAL );
+                data = static_cast< const u8 * >( addr );
+                size = static_cast< u64 >( len );
+            }
+        }
+        ::close( fd );
+        ok = data != nullptr;
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if ( data != nullptr ) {
+            ::munmap( const_cast< u8 * >( data ), size );
+        }
+#endif
+    }
+
+    MappedFile( const MappedFile & )            = delete;
+    MappedFile &operator=( const MappedFile & ) = delete;
+
+    const u8 *data = nullptr;
+    u64       size = 0;
+    bool      ok   = false;
+
+  private:
+#ifdef _WIN32
+    string buf;
+#endif
+};
+
+} // namespace
+
+Result< bool, Errors > write_index_snapshot( const string        &dir_path,
+                                             const IndexSnapshot &snapshot ) {
+    auto snapshot_path = ( filesystem::path( dir_path ) / INDEX_SNAPSHOT_NAME )
+                             .string();
+    auto tmp_path      = snapshot_path + ".tmp";
+    try {
+        filesystem::remove( tmp_path );
+        FileIO       file_io( tmp_path );
+        vector< u8 > buf;
+        u32          crc = 0;
+
+        // 缓冲区写满之后再写入文件，同时累计 crc
+        auto flush = [ & ]( bool force ) {
+            if ( buf.empty() ||
+                 ( !force && buf.size() < SNAPSHOT_WRITE_BUFFER_SIZE ) ) {
+                return;
+            }
+            crc = crc32_update( crc, buf.data(), buf.size() );
+            file_io.write( buf );
+            buf.clear();
+        };
+
+        buf.insert( buf.end(), begin( SNAPSHOT_MAGIC ), end( SNAPSHOT_MAGIC ) );
+        put_fixed< u64 >( buf, snapshot.seq_no );
+        put_fixed< u32 >( buf, snapshot.files.size() );
+        put_fixed< u64 >( buf, snapshot.entries.size() );
+        for ( const auto &file : snapshot.files ) {
+            put_fixed< u32 >( buf, file.file_id );
+            put_fixed< u64 >( buf, file.watermark );
+            put_fixed< u64 >( buf, file.dead_bytes );
+            put_fixed< u64 >( buf, file.min_seq_no );
+            put_fixed< u32 >( buf, file.slot_num );
+        }
+        for ( const auto &[ key, pos ] : snapshot.entries ) {
+            put_fixed< u32 >( buf, key.size() );
+            put_fixed< u32 >( buf, pos.file_id );
+            put_fixed< u64 >( buf, pos.offset );
+            put_fixed< u32 >( buf, pos.size );
+            put_fixed< u32 >( buf, pos.slot );
+            put_fixed< u64 >( buf, pos.expire_at );
+            buf.insert( buf.end(), key.begin(), key.end() );
+            flush( false );
+        }
+        flush( true );
+
+        put_fixed< u32 >( buf, crc );
+        file_io.write( buf );
+        file_io.sync();
+    } catch ( const exception & ) {
+        return Err( Errors::FailedToWriteToDataFile );
+    }
+
+    error_code ec;
+    filesystem::rename( tmp_path, snapshot_path, ec );
+    if ( ec ) {
+        return Err( Errors::FailedToWriteToDataFile );
+    }
+    return Ok( true );
+}
+
+Result< IndexSnapshot, Errors > read_index_snapshot( const string &dir_path ) {
+    MappedFile file(
+        ( filesystem::path( dir_path ) / INDEX_SNAPSHOT_NAME ).string() );
+    if ( !file.ok ) {
+        return Err( Errors::FailedToReadFromDataFile );
+    }
+
+    // 校验 magic 与末尾的 crc
+    if ( file.size < sizeof( SNAPSHOT_MAGIC ) + 4 ||
+         memcmp( file.data, SNAPSHOT_MAGIC, sizeof( SNAPSHOT_MAGIC ) ) != 0 ) {
+        return Err( Errors::IndexSnapshotCorrupted );
+    }
+    u64            body_size = file.size - 4;
+    SnapshotReader crc_reader( file.data + body_size, 4 );
+    u32            crc = 0;
+    crc_reader.get_fixed( crc );
+    if ( crc32( file.data, body_size ) != crc ) {
+        return Err( Errors::IndexSnapshotCorrupted );
+    }
+
+    SnapshotReader reader( file.data + sizeof( SNAPSHOT_MAGIC ),
+                           body_size - sizeof( SNAPSHOT_MAGIC ) );
+    IndexSnapshot  snapshot;
+    u32            file_num  = 0;
+    u64            entry_num = 0;
+    if ( !reader.get_fixed( snapshot.seq_no ) ||
+         !reader.get_fixed( file_num ) || !reader.get_fixed( entry_num ) ) {
+        return Err( Errors::IndexSnapshotCorrupted );
+    }
+
+    for ( u32 i = 0; i < file_num; i++ ) {
+        SnapshotFileInfo info{};
+        if ( !reader.get_fixed( info.file_id ) ||
+             !reader.get_fixed( info.watermark ) ||
+             !reader.get_fixed( info.dead_bytes ) ||
+             !reader.get_fixed( info.min_seq_no ) ||
+             !reader.get_fixed( info.slot_num ) ) {
+            return Err( Errors::IndexSnapshotCorrupted );
+        }
+        snapshot.files.push_back( info );
+    }
+
+    snapshot.entries.reserve( entry_num );
+    for ( u64 i = 0; i < entry_num; i++ ) {
+        u32          key_size = 0, file_id = 0, size = 0, slot = 0;
+        u64          offset = 0, expire_at = 0;
+        vector< u8 > key;
+        if ( !reader.get_fixed( key_size ) || !reader.get_fixed( file_id ) ||
+             !reader.get_fixed( offset ) || !reader.get_fixed( size ) ||
+             !reader.get_fixed( slot ) || !reader.get_fixed( expire_at ) ||
+             !reader.get_bytes( key, key_size ) ) {
+            return Err( Errors::IndexSnapshotCorrupted );
+        }
+        LogRecordPos pos( file_id, offset, size, slot );
+        pos.expire_at = expire_at;
+        snapshot.entries.emplace_back( std::move( key ), pos );
+    }
+    return Ok( std::move( snapshot ) );
+}
+
+bool remove_index_snapshot( const string &dir_path ) {
+    error_code ec;
+    return filesystem::remove(
+        filesystem::path( dir_path ) / INDEX_SNAPSHOT_NAME, ec );
+}
+
+} // namespace bitcask
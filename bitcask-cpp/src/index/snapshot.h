@@ -0,0 +1,54 @@
+#pragma once
+#include "../data/log_record.h"
+#include "../errors.h"
+#include "../utils/Result.h"
+#include "../utils/type.h"
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+namespace bitcask {
+
+// 索引快照的文件名
+constexpr string_view INDEX_SNAPSHOT_NAME = "INDEX_SNAPSHOT";
+
+// 索引快照覆盖的数据文件信息
+struct SnapshotFileInfo {
+    u32 file_id;
+    // 快照包含该文件中 [0, watermark) 范围内的全部记录
+    u64 watermark;
+    u64 dead_bytes;
+    u64 min_seq_no;
+    // 快照时已经分配的记录序号数量，恢复失效位图并继续分配序号
+    u32 slot_num;
+};
+
+// 某一时刻内存索引的完整内容，以及它覆盖到的各数据文件的位置
+struct IndexSnapshot {
+    u64                                          seq_no = 0;
+    vector< SnapshotFileInfo >                   files;
+    vector< pair< vector< u8 >, LogRecordPos > > entries;
+};
+
+// 将快照写入 dir_path 下的快照文件，先写临时文件再重命名。
+// entries 需要按 key 有序。
+//
+// 格式均为小端序的定长字段，加载时直接 mmap 整个文件顺序解析:
+// | magic | seq no u64 | file num u32 | entry num u64 |
+// | file id u32 | watermark u64 | dead bytes u64 | min seq no u64 |
+// | slot num u32 | ...
+// | key size u32 | file id u32 | offset u64 | size u32 | slot u32 |
+// | expire at u64 | key | ...
+// | crc u32 |
+Result< bool, Errors > write_index_snapshot( const string        &dir_path,
+                                             const IndexSnapshot &snapshot );
+
+// 读取快照文件，不存在时返回 FailedToReadFromDataFile，
+// 内容损坏时返回 IndexSnapshotCorrupted
+Result< IndexSnapshot, Errors > read_index_snapshot( const string &dir_path );
+
+// 删除快照文件，返回快照文件此前是否存在
+bool remove_index_snapshot( const string &dir_path );
+
+} // namespace bitcask
@@ -1,8 +1,14 @@
+#include "bench.h"
 #include "test.h"
+#include <string_view>
 
 using namespace bitcask;
 
-int main() {
+int main( int argc, char *argv[] ) {
+    if ( argc > 1 && string_view( argv[ 1 ] ) == "bench" ) {
+        bench();
+        return 0;
+    }
     test();
     return 0;
 }
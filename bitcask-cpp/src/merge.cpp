@@ -0,0 +1,317 @@
+#include "db.h"
+#include "data/hint_file.h"
+#include "index/snapshot.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+
+namespace bitcask {
+
+// merge 的流程:
+// 1. 从当前的旧数据文件中挑选无效数据比例达到 merge_garbage_ratio 的文件作为输入，
+//    活跃文件不参与 merge;
+// 2. 顺序读取输入文件中的记录 (优先读取 hint 文件)，索引仍然指向该位置的记录
+//    才是有效数据。相邻的有效记录合并成一段，整段原样 (保留序列号) 拷贝到新的
+//    输出文件中，Linux 下通过 copy_file_range 完成，不经过用户态缓冲区。
+//    批量写入的记录单独重新编码，见 merge_files;
+// 3. 持有 key 对应的分段锁，再次确认索引没有被前台修改之后，将索引指向新位置。
+//    已经过期的记录不再拷贝，直接移除索引;
+// 4. 输出文件在创建时就加入旧数据文件集合，写满之后生成对应的 hint 文件，
+//    所有数据处理完之后再移除并删除输入文件。
+// 输入文件可以分给多个工作线程，每个线程写入各自的输出文件，
+// 全部完成之后再一起移除输入文件。
+// 前台读写只会在单个 key 的分段锁上与 merge 竞争，读者在文件被替换时会重新查询索引。
+Result< bool, Errors > Engine::merge() {
+    // 索引加载完成之前无法判断记录是否有效
+    if ( auto res = wait_index_loaded(); res.is_err() ) {
+        return res;
+    }
+
+    unique_lock< mutex > merge_lock( merge_mutex, try_to_lock );
+    if ( !merge_lock.owns_lock() ) {
+        return Err( Errors::MergeInProgress );
+    }
+
+    // 不参与 merge 的文件中可能存在同一个 key 更旧的记录，
+    // 只有序列号比这些文件中所有记录都小的墓碑值才能丢弃
+    u64         min_outside_seq_no = UINT64_MAX;
+    DataFileMap inputs;
+    for ( const auto &[ file_id, data_file ] : *older_files.load() ) {
+        if ( data_file->get_garbage_ratio() >= options.merge_garbage_ratio ) {
+            inputs.emplace( file_id, data_file );
+        } else {
+            min_outside_seq_no =
+                min( min_outside_seq_no, data_file->get_min_seq_no() );
+        }
+    }
+    if ( inputs.empty() ) {
+        return Ok( true );
+    }
+
+    // merge 写入的记录保留原有的序列号，不能在快照之后重放，先让快照失效，
+    // merge 成功之后再重新生成。merge 失败时不再有快照，下次打开时完整加载
+    bool had_snapshot = remove_index_snapshot( options.dir_path );
+    for ( const auto &slot : active_files ) {
+        min_outside_seq_no =
+            min( min_outside_seq_no, slot->data_file.load()->get_min_seq_no() );
+    }
+
+    // 按文件大小把输入分给各个工作线程，每次分给当前数据量最少的线程
+    u64 thread_num = options.merge_threads;
+    if ( thread_num == 0 ) {
+        thread_num = max( 1u, thread::hardware_concurrency() );
+    }
+    thread_num = min< u64 >( thread_num, inputs.size() );
+
+    vector< shared_ptr< DataFile > > sorted_inputs;
+    for ( const auto &[ file_id, data_file ] : inputs ) {
+        sorted_inputs.push_back( data_file );
+    }
+    sort( sorted_inputs.begin(), sorted_inputs.end(),
+          []( const auto &lhs, const auto &rhs ) {
+              return lhs->get_write_off() > rhs->get_write_off();
+          } );
+    vector< vector< shared_ptr< DataFile > > > partitions( thread_num );
+    vector< u64 >                              partition_bytes( thread_num );
+    for ( const auto &data_file : sorted_inputs ) {
+        u64 w = min_element( partition_bytes.begin(), partition_bytes.end() ) -
+                partition_bytes.begin();
+        partitions[ w ].push_back( data_file );
+        partition_bytes[ w ] += data_file->get_write_off();
+    }
+
+    // 各个工作线程互不影响，只在 key 的分段锁、旧数据文件集合和限速器上同步
+    vector< future< Result< bool, Errors > > > workers;
+    for ( u64 w = 1; w < thread_num; w++ ) {
+        workers.push_back( async( launch::async, [ &, w ] {
+            return merge_files( partitions[ w ], min_outside_seq_no );
+        } ) );
+    }
+    auto result = merge_files( partitions[ 0 ], min_outside_seq_no );
+    for ( auto &worker : workers ) {
+        auto res = worker.get();
+        if ( result.is_ok() && res.is_err() ) {
+            result = res;
+        }
+    }
+    if ( result.is_err() ) {
+        return result;
+    }
+
+    // 所有输出文件都已经持久化，一次性移除并删除全部输入文件。
+    // 仍持有输入文件引用的读者可以继续通过已打开的文件描述符读取，
+    // 快照引用的文件则保留到快照释放。
+    vector< u32 > removed;
+    for ( const auto &[ file_id, data_file ] : inputs ) {
+        removed.push_back( file_id );
+    }
+    retire_data_files( removed );
+
+    if ( had_snapshot ) {
+        return write_checkpoint();
+    }
+    return Ok( true );
+}
+
+Result< bool, Errors >
+Engine::merge_files( const vector< shared_ptr< DataFile > > &inputs,
+                     u64 min_outside_seq_no ) {
+    shared_ptr< DataFile > output;
+    vector< HintRecord >   output_hints;
+
+    // 持久化输出文件并生成 hint 文件
+    auto finish_output = [ & ]() -> Result< bool, Errors > {
+        if ( output == nullptr ) {
+            return Ok( true );
+        }
+        if ( auto res = output->sync(); res.is_err() ) {
+            return res;
+        }
+        auto res = write_hint_file( options.dir_path, output->get_file_id(),
+                                    output_hints );
+        output_hints.clear();
+        return res;
+    };
+
+    // 等待拷贝到当前输出文件的一段连续有效记录，对应输入文件中的
+    // [run_start, run_end)。整段数据原样拷贝，不经过记录的解码和编码
+    shared_ptr< DataFile > run_file;
+    u64                    run_start    = 0;
+    u64                    run_end      = 0;
+    bool                   run_in_batch = false;
+    vector< HintRecord >   run;
+
+    // 批量写入的记录单独成段，清除 LOG_RECORD_BATCH_FLAG 之后重新编码写入:
+    // 输出文件中没有对应的提交标识，保留该标识的记录会在崩溃恢复时被当作
+    // 未提交的批量写入截断。清除标识不改变记录的长度
+    auto copy_run = [ & ]() -> Result< u64, Errors > {
+        if ( !run_in_batch ) {
+            return output->copy_from( *run_file, run_start,
+                                      run_end - run_start,
+                                      options.merge_zero_copy );
+        }
+        auto res = run_file->read_log_record( run_start, run_end );
+        if ( res.is_err() ) {
+            return Err( res.unwrap_err() );
+        }
+        auto record     = res.unwrap().record;
+        record.in_batch = false;
+        auto enc_record = record.encode();
+        u64  offset     = output->reserve( enc_record.size() );
+        auto write_res  = output->write_at( enc_record, offset );
+        output->publish( offset, enc_record.size() );
+        if ( write_res.is_err() ) {
+            return Err( write_res.unwrap_err() );
+        }
+        return Ok( offset );
+    };
+
+    auto flush_run = [ & ]() -> Result< bool, Errors > {
+        if ( run.empty() ) {
+            return Ok( true );
+        }
+        merge_limiter.acquire( run_end - run_start );
+        auto res = copy_run();
+        if ( res.is_err() ) {
+            return Err( res.unwrap_err() );
+        }
+
+        u64 base = res.unwrap();
+        u32 first_slot =
+            output->reserve_slots( static_cast< u32 >( run.size() ) );
+        for ( u64 k = 0; k < run.size(); k++ ) {
+            auto        &record = run[ k ];
+            LogRecordPos new_pos( output->get_file_id(),
+                                  base + record.pos.offset - run_start,
+                                  record.pos.size, first_slot + k );
+            new_pos.expire_at = record.pos.expire_at;
+            output->observe_seq_no( record.seq_no );
+
+            if ( record.rec_type == LogRecordType::DELETED ) {
+                add_dead_bytes( new_pos );
+            } else {
+                // 前台可能在拷贝期间修改了该 key，只有索引仍指向旧位置时才更新，
+                // 否则拷贝出的记录就是无效数据
+                // 内联的 value 随记录一起保留
+                lock_guard< mutex > lock( key_lock( record.key ) );
+                auto entry = index->get_entry( record.key );
+                if ( entry.has_value() && entry->pos == record.pos ) {
+                    index->put( record.key, new_pos,
+                                std::move( entry->value ) );
+                } else {
+                    add_dead_bytes( new_pos );
+                }
+            }
+            output_hints.push_back( HintRecord{ std::move( record.key ),
+                                                record.rec_type,
+                                                record.seq_no, new_pos,
+                                                false } );
+        }
+        run.clear();
+        return Ok( true );
+    };
+
+    for ( const auto &data_file : inputs ) {
+        // 只需要记录的 key 和位置，优先读取 hint 文件
+        u32  file_id = data_file->get_file_id();
+        auto records = read_hint_file( options.dir_path, file_id );
+        if ( records.is_err() ) {
+            merge_limiter.acquire( data_file->get_write_off() );
+            records = build_hint_records( *data_file );
+            if ( records.is_err() ) {
+                return Err( records.unwrap_err() );
+            }
+        }
+
+        // 失效位图中标记的记录一定是无效数据，不需要查询索引。
+        // 之后才失效的记录会在更新索引时被发现
+        auto dead_map = data_file->get_dead_map();
+        auto is_dead  = [ & ]( const HintRecord &record ) {
+            if ( !dead_map.has_value() ) {
+                return index->get( record.key ) != record.pos;
+            }
+            u64 slot = record.pos.slot;
+            return slot / 64 < dead_map->size() &&
+                   ( ( *dead_map )[ slot / 64 ] >> ( slot % 64 ) & 1 ) != 0;
+        };
+
+        for ( auto &record : records.unwrap() ) {
+            if ( record.rec_type == LogRecordType::DELETED ) {
+                // 仍可能遮挡其他文件中旧记录的墓碑值需要保留
+                if ( record.seq_no < min_outside_seq_no ) {
+                    continue;
+                }
+            } else if ( is_dead( record ) ) {
+                // 被覆盖或删除的无效数据
+                continue;
+            } else if ( is_expired( record.pos ) &&
+                        record.seq_no < min_outside_seq_no ) {
+                // 已经过期的数据，同一个 key 更旧的记录都在输入文件中，
+                // 不需要墓碑值遮挡，直接丢弃并移除索引
+                lock_guard< mutex > lock( key_lock( record.key ) );
+                auto                entry = index->get_entry( record.key );
+                if ( entry.has_value() && entry->pos == record.pos ) {
+                    index->del( record.key );
+                    continue;
+                }
+            }
+
+            // 输出文件写满时切换新的输出文件
+            u64 pending = run.empty() ? 0 : run_end - run_start;
+            if ( output == nullptr ||
+                 output->get_write_off() + pending + record.pos.size >
+                     options.data_file_size ) {
+                if ( auto res = flush_run(); res.is_err() ) {
+                    return res;
+                }
+                if ( auto res = finish_output(); res.is_err() ) {
+                    return res;
+                }
+                auto res = open_merge_file();
+                if ( res.is_err() ) {
+                    return Err( res.unwrap_err() );
+                }
+                output = res.unwrap();
+            }
+
+            // 与当前这段记录不相邻或者涉及批量写入的记录时，先拷贝已经积累的记录
+            if ( !run.empty() && ( run_end != record.pos.offset ||
+                                   run_in_batch || record.in_batch ) ) {
+                if ( auto res = flush_run(); res.is_err() ) {
+                    return res;
+                }
+            }
+            if ( run.empty() ) {
+                run_file     = data_file;
+                run_start    = record.pos.offset;
+                run_in_batch = record.in_batch;
+            }
+            run_end = record.pos.offset + record.pos.size;
+            run.push_back( std::move( record ) );
+        }
+        if ( auto res = flush_run(); res.is_err() ) {
+            return res;
+        }
+    }
+
+    if ( auto res = finish_output(); res.is_err() ) {
+        return res;
+    }
+    return Ok( true );
+}
+
+Result< shared_ptr< DataFile >, Errors > Engine::open_merge_file() {
+    shared_ptr< DataFile > data_file;
+    try {
+        data_file = make_shared< DataFile >( options.dir_path,
+                                             next_file_id.fetch_add( 1 ) );
+    } catch ( const runtime_error & ) {
+        return Err( Errors::FailedToOpenDataFile );
+    }
+    // 在索引指向该文件之前，保证读者能够找到它
+    replace_older_files( {}, { data_file } );
+    return Ok( data_file );
+}
+
+} // namespace bitcask
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "utils/type.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace bitcask {
+
+enum class IndexType {
+    // BTree 索引
+    BTree,
+};
+
+// 配置项
+struct Options {
+    // 数据库目录
+    string dir_path;
+
+    // 数据文件大小
+    u64 data_file_size = 256 * 1024 * 1024;
+
+    // 是否每次写都持久化
+    bool sync_writes = false;
+
+    // 索引类型
+    IndexType index_type = IndexType::BTree;
+
+    // 同时打开的活跃文件数量，大于 1 时不同线程写入不同的活跃文件
+    u32 active_file_num = 1;
+
+    // 启动时并行解码数据文件的线程数，为 0 时使用 CPU 核数
+    u32 index_load_threads = 0;
+
+    // 是否延迟加载旧数据文件的索引。打开时只加载活跃文件以及缺少 hint 文件的
+    // 数据文件，其余文件由后台线程从新到旧加载，加载完成之前未命中索引的 get
+    // 会根据 key 摘要立即加载可能包含该 key 的文件
+    bool lazy_index_load = false;
+
+    // 后台 merge 的间隔，为 0 时不启动后台 merge 线程
+    u64 merge_interval_ms = 0;
+
+    // merge 的工作线程数，为 0 时使用 CPU 核数。输入文件按大小分给各个线程，
+    // 每个线程写入各自的输出文件，共享读写限速
+    u32 merge_threads = 1;
+
+    // merge 读写数据的限速，为 0 时不限速
+    u64 merge_bytes_per_sec = 0;
+
+    // merge 时连续的有效记录是否通过 copy_file_range 在内核中拷贝，
+    // 不支持时自动退回到经过用户态缓冲区的拷贝
+    bool merge_zero_copy = true;
+
+    // 旧数据文件中无效数据的比例达到该阈值时才参与 merge，
+    // 为 0 时 merge 所有旧数据文件
+    double merge_garbage_ratio = 0.5;
+
+    // 读取路径上 value 缓存的字节预算，为 0 时不缓存
+    u64 value_cache_bytes = 0;
+
+    // 长度不超过该值的 value 直接保存在内存索引中，get 时不需要读取数据文件，
+    // 最大为 255，为 0 时不内联。从 hint 文件或索引快照加载的 key 在第一次
+    // 读取之后内联
+    u32 inline_value_size = 0;
+
+    // 过期时间的精度。带有过期时间的 key 由后台线程每隔一个 tick 检查并写入
+    // 墓碑值，读取时也按这个精度判断是否过期
+    u64 ttl_tick_ms = 100;
+};
+
+// 批量写入的配置项
+struct WriteBatchOptions {
+    // 一次批量写入最多包含的记录数量
+    u64 max_batch_num = 10000;
+
+    // 提交时是否持久化
+    bool sync_writes = true;
+};
+
+// 遍历索引的配置项，prefix 与 [lower_bound, upper_bound) 同时指定时取交集
+struct IteratorOptions {
+    // 只遍历以 prefix 开头的 key，为空时不限制
+    vector< u8 > prefix;
+
+    // 遍历的下界 (包含)，不设置时不限制
+    optional< vector< u8 > > lower_bound;
+
+    // 遍历的上界 (不包含)，不设置时不限制
+    optional< vector< u8 > > upper_bound;
+
+    // 是否按 key 从大到小反向遍历
+    bool reverse = false;
+};
+
+} // namespace bitcask
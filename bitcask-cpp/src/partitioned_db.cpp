@@ -0,0 +1,301 @@
+#include "partitioned_db.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <optional>
+#include <queue>
+
+namespace bitcask {
+
+namespace {
+
+// 记录分区数量的文件
+constexpr string_view PARTITION_META_FILE_NAME = "PARTITIONS";
+
+string partition_dir_path( const string &dir_path, u32 partition ) {
+    char name[ 32 ];
+    snprintf( name, sizeof( name ), "partition-%03u", partition );
+    return ( filesystem::path( dir_path ) / name ).string();
+}
+
+// 读取或写入分区数量，已存在时必须与 partition_num 一致
+optional< Errors > check_partition_meta( const string &dir_path,
+                                         u32           partition_num ) {
+    auto meta_path = filesystem::path( dir_path ) / PARTITION_META_FILE_NAME;
+    if ( filesystem::exists( meta_path ) ) {
+        ifstream in( meta_path );
+        u32      stored_num = 0;
+        if ( !( in >> stored_num ) ) {
+            return Errors::DataDirCorrupted;
+        }
+        if ( stored_num != partition_num ) {
+            return Errors::PartitionNumMismatch;
+        }
+        return nullopt;
+    }
+
+    ofstream out( meta_path );
+    if ( !( out << partition_num << endl ) ) {
+        return Errors::FailedToCreateDatabaseDir;
+    }
+    return nullopt;
+}
+
+} // namespace
+
+Result< shared_ptr< PartitionedEngine >, Errors >
+PartitionedEngine::open( const Options &options, u32 partition_num ) {
+    if ( options.dir_path.empty() ) {
+        return Err( Errors::DirPathIsEmpty );
+    }
+    if ( partition_num == 0 ) {
+        return Err( Errors::PartitionNumIsInvalid );
+    }
+
+    error_code ec;
+    if ( !filesystem::is_directory( options.dir_path, ec ) ) {
+        if ( !filesystem::create_directories( options.dir_path, ec ) ) {
+            return Err( Errors::FailedToCreateDatabaseDir );
+        }
+    }
+    if ( auto err = check_partition_meta( options.dir_path, partition_num );
+         err.has_value() ) {
+        return Err( *err );
+    }
+
+    // 并行打开各个分区，加载索引的耗时随分区数量分摊
+    vector< future< Result< shared_ptr< Engine >, Errors > > > futures;
+    for ( u32 i = 0; i < partition_num; i++ ) {
+        Options partition_options  = options;
+        partition_options.dir_path = partition_dir_path( options.dir_path, i );
+        futures.push_back( async( launch::async, [ partition_options ]() {
+            return Engine::open( partition_options );
+        } ) );
+    }
+
+    shared_ptr< PartitionedEngine > engine( new PartitionedEngine() );
+    optional< Errors >              open_err;
+    for ( auto &future : futures ) {
+        auto res = future.get();
+        if ( res.is_err() ) {
+            open_err = res.unwrap_err();
+            continue;
+        }
+        engine->partitions.push_back( res.unwrap() );
+    }
+    if ( open_err.has_value() ) {
+        return Err( *open_err );
+    }
+    return Ok( engine );
+}
+
+u32 PartitionedEngine::partition_of( const vector< u8 > &key ) const {
+    // FNV-1a，与平台和标准库实现无关
+    u64 hash = 14695981039346656037ull;
+    for ( u8 byte : key ) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    return hash % partitions.size();
+}
+
+Result< bool, Errors > PartitionedEngine::put( const vector< u8 > &key,
+                                               const vector< u8 > &value,
+                                               u64                 ttl_ms ) {
+    return partitions[ partition_of( key ) ]->put( key, value, ttl_ms );
+}
+
+Result< vector< u8 >, Errors >
+PartitionedEngine::get( const vector< u8 > &key ) {
+    return partitions[ partition_of( key ) ]->get( key );
+}
+
+Result< bool, Errors > PartitionedEngine::del( const vector< u8 > &key ) {
+    return partitions[ partition_of( key ) ]->del( key );
+}
+
+Result< bool, Errors >
+PartitionedEngine::compare_and_swap( const vector< u8 >             &key,
+                                     const optional< vector< u8 > > &expected,
+                                     const vector< u8 > &new_value ) {
+    return partitions[ partition_of( key ) ]->compare_and_swap( key, expected,
+                                                                new_value );
+}
+
+Result< i64, Errors > PartitionedEngine::increment( const vector< u8 > &key,
+                                                    i64 delta ) {
+    return partitions[ partition_of( key ) ]->increment( key, delta );
+}
+
+Result< bool, Errors > PartitionedEngine::sync() {
+    for ( auto &partition : partitions ) {
+        if ( auto res = partition->sync(); res.is_err() ) {
+            return res;
+        }
+    }
+    return Ok( true );
+}
+
+vector< Result< vector< u8 >, Errors > >
+PartitionedEngine::multi_get( const vector< vector< u8 > > &keys ) {
+    // 按分区对 key 的下标进行分组
+    vector< vector< u64 > > groups( partitions.size() );
+    for ( u64 i = 0; i < keys.size(); i++ ) {
+        groups[ partition_of( keys[ i ] ) ].push_back( i );
+    }
+
+    vector< optional< Result< vector< u8 >, Errors > > > results( keys.size() );
+    auto get_group = [ & ]( u32 partition ) {
+        vector< vector< u8 > > group_keys;
+        group_keys.reserve( groups[ partition ].size() );
+        for ( u64 i : groups[ partition ] ) {
+            group_keys.push_back( keys[ i ] );
+        }
+        auto values = partitions[ partition ]->multi_get( group_keys );
+        for ( u64 k = 0; k < values.size(); k++ ) {
+            results[ groups[ partition ][ k ] ] = std::move( values[ k ] );
+        }
+    };
+
+    // 除最后一个非空分组外，其余分组交给其他线程并行读取
+    vector< future< void > > futures;
+    optional< u32 >          local_group;
+    for ( u32 p = 0; p < groups.size(); p++ ) {
+        if ( groups[ p ].empty() ) {
+            continue;
+        }
+        if ( local_group.has_value() ) {
+            futures.push_back(
+                async( launch::async, get_group, *local_group ) );
+        }
+        local_group = p;
+    }
+    if ( local_group.has_value() ) {
+        get_group( *local_group );
+    }
+    for ( auto &future : futures ) {
+        future.get();
+    }
+
+    vector< Result< vector< u8 >, Errors > > values;
+    values.reserve( keys.size() );
+    for ( auto &result : results ) {
+        values.push_back( std::move( *result ) );
+    }
+    return values;
+}
+
+vector< vector< u8 > > PartitionedEngine::list_keys() {
+    // 各分区的 key 有序且互不相交，多路归并即可得到全局有序的结果
+    vector< vector< vector< u8 > > > partition_keys;
+    u64                              total = 0;
+    for ( auto &partition : partitions ) {
+        partition_keys.push_back( partition->list_keys() );
+        total += partition_keys.back().size();
+    }
+
+    // 小顶堆中保存 (分区, 下标)
+    auto greater = [ & ]( const pair< u32, u64 > &a,
+                          const pair< u32, u64 > &b ) {
+        return partition_keys[ a.first ][ a.second ] >
+               partition_keys[ b.first ][ b.second ];
+    };
+    priority_queue< pair< u32, u64 >, vector< pair< u32, u64 > >,
+                    decltype( greater ) >
+        heap( greater );
+    for ( u32 p = 0; p < partition_keys.size(); p++ ) {
+        if ( !partition_keys[ p ].empty() ) {
+            heap.emplace( p, 0 );
+        }
+    }
+
+    vector< vector< u8 > > keys;
+    keys.reserve( total );
+    while ( !heap.empty() ) {
+        auto [ p, i ] = heap.top();
+        heap.pop();
+        keys.push_back( std::move( partition_keys[ p ][ i ] ) );
+        if ( i + 1 < partition_keys[ p ].size() ) {
+            heap.emplace( p, i + 1 );
+        }
+    }
+    return keys;
+}
+
+Result< bool, Errors > PartitionedEngine::fold(
+    const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+        &fn ) {
+    return scan( IteratorOptions(), fn );
+}
+
+Result< bool, Errors > PartitionedEngine::scan(
+    const IteratorOptions &options,
+    const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+        &fn ) {
+    // 各分区的 key 有序且互不相交，对各分区的索引迭代器进行多路归并。
+    // 与 Engine::scan 相同，每个分区每次取出一批 key 并批量读取 value
+    struct Cursor {
+        unique_ptr< IndexIterator >              iter;
+        vector< vector< u8 > >                   keys;
+        vector< Result< vector< u8 >, Errors > > values;
+        u64                                      next = 0;
+    };
+    vector< Cursor > cursors( partitions.size() );
+
+    // 读取分区的下一批数据，没有更多数据时返回 false
+    auto fill = [ & ]( u32 p ) {
+        auto                            &cursor = cursors[ p ];
+        vector< optional< IndexEntry > > entries;
+        cursor.keys.clear();
+        for ( ; cursor.iter->valid() &&
+                cursor.keys.size() < Engine::SCAN_PREFETCH_NUM;
+              cursor.iter->next() ) {
+            cursor.keys.push_back( cursor.iter->key() );
+            entries.push_back( cursor.iter->entry() );
+        }
+        cursor.values = partitions[ p ]->read_values( cursor.keys, entries );
+        cursor.next   = 0;
+        return !cursor.keys.empty();
+    };
+
+    // 堆顶为遍历方向上下一个 key 所在的分区
+    auto after = [ & ]( u32 a, u32 b ) {
+        const auto &key_a = cursors[ a ].keys[ cursors[ a ].next ];
+        const auto &key_b = cursors[ b ].keys[ cursors[ b ].next ];
+        return options.reverse ? key_a < key_b : key_a > key_b;
+    };
+    priority_queue< u32, vector< u32 >, decltype( after ) > heap( after );
+    for ( u32 p = 0; p < partitions.size(); p++ ) {
+        auto &partition = partitions[ p ];
+        if ( auto res = partition->wait_index_loaded(); res.is_err() ) {
+            return res;
+        }
+        cursors[ p ].iter = partition->index->iterator( options );
+        if ( fill( p ) ) {
+            heap.push( p );
+        }
+    }
+
+    while ( !heap.empty() ) {
+        u32 p = heap.top();
+        heap.pop();
+        auto &cursor = cursors[ p ];
+        u64   i      = cursor.next++;
+        auto &value  = cursor.values[ i ];
+        if ( value.is_err() ) {
+            // 遍历过程中被并发删除的 key 直接跳过
+            if ( value.unwrap_err() != Errors::KeyNotFound ) {
+                return Err( value.unwrap_err() );
+            }
+        } else if ( !fn( cursor.keys[ i ], value.unwrap() ) ) {
+            return Ok( true );
+        }
+        if ( cursor.next < cursor.keys.size() || fill( p ) ) {
+            heap.push( p );
+        }
+    }
+    return Ok( true );
+}
+
+} // namespace bitcask
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "db.h"
+#include "errors.h"
+#include "options.h"
+#include "utils/Result.h"
+#include "utils/nocopyable.h"
+#include "utils/type.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace bitcask {
+
+// 按 key 的哈希值分区的存储引擎
+//
+// 每个分区都是一个独立的 Engine 实例，拥有自己的目录、活跃文件和内存索引，
+// 分区之间没有任何共享的锁，写入吞吐可以随分区数量线性扩展。
+// 分区数量在第一次打开时写入 PARTITIONS 文件，之后打开时必须保持一致。
+class PartitionedEngine : public Nocopyable {
+  public:
+    // 打开 partition_num 个分区，options.dir_path 为所有分区的父目录
+    static Result< shared_ptr< PartitionedEngine >, Errors >
+    open( const Options &options, u32 partition_num );
+
+    Result< bool, Errors > put( const vector< u8 > &key,
+                                const vector< u8 > &value, u64 ttl_ms = 0 );
+
+    Result< vector< u8 >, Errors > get( const vector< u8 > &key );
+
+    Result< bool, Errors > del( const vector< u8 > &key );
+
+    Result< bool, Errors >
+    compare_and_swap( const vector< u8 >             &key,
+                      const optional< vector< u8 > > &expected,
+                      const vector< u8 >             &new_value );
+
+    Result< i64, Errors > increment( const vector< u8 > &key, i64 delta );
+
+    Result< bool, Errors > sync();
+
+    // 批量获取数据，按分区分组后并行读取，结果与 keys 的顺序一一对应
+    vector< Result< vector< u8 >, Errors > >
+    multi_get( const vector< vector< u8 > > &keys );
+
+    // 合并所有分区的 key，按全局顺序返回
+    vector< vector< u8 > > list_keys();
+
+    // 按全局 key 的顺序遍历所有分区的数据，fn 返回 false 时停止遍历
+    Result< bool, Errors > fold(
+        const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+            &fn );
+
+    // 按 options 指定的范围和方向遍历所有分区的数据，结果全局有序，
+    // fn 返回 false 时停止遍历
+    Result< bool, Errors > scan(
+        const IteratorOptions &options,
+        const function< bool( const vector< u8 > &, const vector< u8 > & ) >
+            &fn );
+
+    u32 get_partition_num() const {
+        return partitions.size();
+    }
+
+    // key 所在的分区，哈希函数固定，保证重新打开之后路由不变
+    u32 partition_of( const vector< u8 > &key ) const;
+
+  private:
+    PartitionedEngine() = default;
+
+    vector< shared_ptr< Engine > > partitions;
+};
+
+} // namespace bitcask
@@ -1,10 +1,19 @@
 #include "test.h"
+#include "db.h"
+#include "cache/value_cache.h"
+#include "data/hint_file.h"
+#include "index/snapshot.h"
+#include "partitioned_db.h"
 #include "fio/file.h"
 #include "fio/file_io.h"
 #include "utils/Result.h"
 #include "utils/RwLock.h"
+#include "utils/SeqLock.h"
+#include "utils/TimerWheel.h"
 #include "utils/macro.h"
 #include "utils/type.h"
+#include <algorithm>
+#include <filesystem>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -20,13 +29,25 @@ void test_btree_put() {
     vector< u8 > vec_str1( str1.begin(), str1.end() );
     LogRecordPos pos( 1, 10 );
     auto         res1 = bt.put( vec_str1, pos );
-    ASSERT_EQ( res1, true );
+    ASSERT_EQ( res1.has_value(), false );
 
     string       str2 = "aa";
     vector< u8 > vec_str2( str2.begin(), str2.end() );
     LogRecordPos pos2( 2, 20 );
     auto         res2 = bt.put( vec_str2, pos2 );
-    ASSERT_EQ( res2, true );
+    ASSERT_EQ( res2.has_value(), false );
+
+    // 覆盖写时返回旧的位置信息
+    LogRecordPos pos3( 3, 30 );
+    auto         res3 = bt.put( vec_str1, pos3 );
+    ASSERT_EQ( res3.has_value(), true );
+    ASSERT_EQ( res3->file_id, pos.file_id );
+    ASSERT_EQ( res3->offset, pos.offset );
+
+    // 覆盖之后只保留新的位置信息
+    auto res4 = bt.get( vec_str1 );
+    ASSERT( res4.has_value() && *res4 == pos3 );
+    ASSERT_EQ( bt.list_keys().size(), 2 );
 }
 void test_btree_mutilthread_put() {
     // 创建多线程程序测试put函数的线程安全性
@@ -38,7 +59,7 @@ void test_btree_mutilthread_put() {
             vector< u8 > vec_str( str.begin(), str.end() );
             LogRecordPos pos( 1, 10 );
             auto         res = bt.put( vec_str, pos );
-            ASSERT_EQ( res, true );
+            ASSERT_EQ( res.has_value(), false );
         } ) );
     }
     for ( auto &thread : threads ) {
@@ -51,19 +72,19 @@ void test_btree_get() {
     vector< u8 > vec_str1( str1.begin(), str1.end() );
     LogRecordPos pos1( 1, 10 );
     auto         res1 = bt.put( vec_str1, pos1 );
-    ASSERT_EQ( res1, true );
+    ASSERT_EQ( res1.has_value(), false );
 
     string       str2 = "aa";
     vector< u8 > vec_str2( str2.begin(), str2.end() );
     LogRecordPos pos2( 2, 20 );
     auto         res2 = bt.put( vec_str2, pos2 );
-    ASSERT_EQ( res2, true );
+    ASSERT_EQ( res2.has_value(), false );
 
-    LogRecordPos pos3 = bt.get( vec_str1 );
+    LogRecordPos pos3 = bt.get( vec_str1 ).value();
     ASSERT_EQ( pos3.file_id, pos1.file_id );
     ASSERT_EQ( pos3.offset, pos1.offset );
 
-    LogRecordPos pos4 = bt.get( vec_str2 );
+    LogRecordPos pos4 = bt.get( vec_str2 ).value();
     ASSERT_EQ( pos4.file_id, pos2.file_id );
     ASSERT_EQ( pos4.offset, pos2.offset );
 }
@@ -74,24 +95,25 @@ void test_btree_del() {
     vector< u8 > vec_str1( str1.begin(), str1.end() );
     LogRecordPos pos1( 1, 10 );
     auto         res1 = bt.put( vec_str1, pos1 );
-    ASSERT_EQ( res1, true );
+    ASSERT_EQ( res1.has_value(), false );
 
     string       str2 = "aa";
     vector< u8 > vec_str2( str2.begin(), str2.end() );
     LogRecordPos pos2( 2, 20 );
     auto         res2 = bt.put( vec_str2, pos2 );
-    ASSERT_EQ( res2, true );
+    ASSERT_EQ( res2.has_value(), false );
 
     auto del1 = bt.del( vec_str1 );
-    ASSERT_EQ( del1, true );
+    ASSERT_EQ( del1.has_value(), true );
+    ASSERT_EQ( del1->offset, pos1.offset );
 
     auto del2 = bt.del( vec_str2 );
-    ASSERT_EQ( del2, true );
+    ASSERT_EQ( del2.has_value(), true );
     string       str3 = "not exits";
     vector< u8 > vec_str3( str3.begin(), str3.end() );
 
     auto del3 = bt.del( vec_str3 );
-    ASSERT_EQ( del3, false );
+    ASSERT_EQ( del3.has_value(), false );
 }
 
 void test_file_io_read() {
@@ -222,31 +244,1799 @@ void test_string_view() {
 }
 
 void test_RwLock() {
-    int           data = 0;
-    RwLock< int > rwlock( data );
-    // 创建不同线程，读写data，验证读写锁的有效性
+    // 写者之间、写者与读者之间互斥: 写者成对修改两个值，读者总是看到相等的一对
+    RwLock< pair< u64, u64 > > rwlock( make_pair( 0, 0 ) );
+    atomic< bool >             torn = false;
+    const u64                  WRITES_PER_THREAD = 2000;
+
+    vector< thread > threads;
+    for ( int t = 0; t < 4; t++ ) {
+        threads.emplace_back( [ & ]() {
+            for ( u64 i = 0; i < WRITES_PER_THREAD; i++ ) {
+                auto writeguard = rwlock.write();
+                writeguard.data().first++;
+                this_thread::yield();
+                writeguard.data().second++;
+            }
+        } );
+        threads.emplace_back( [ & ]() {
+            for ( u64 i = 0; i < WRITES_PER_THREAD; i++ ) {
+                auto readguard = rwlock.read();
+                if ( readguard.data().first != readguard.data().second ) {
+                    torn = true;
+                }
+            }
+        } );
+    }
+    for ( auto &t : threads ) {
+        t.join();
+    }
+    ASSERT( !torn );
+    ASSERT_EQ( rwlock.read().data().first, 4 * WRITES_PER_THREAD );
+
+    // 写者优先: 读者经由底层读写锁持有锁，写者在 m_waiting_writers 中等待，
+    // 期间即使读偏置已经重新开启，新的读者也不能进入
+    ScalableSharedMutex mutex( true );
+    mutex.lock();
+    mutex.unlock();
+    mutex.lock_shared();
+    // 抑制期过后，连续的慢速加锁重新开启读偏置
+    this_thread::sleep_for( chrono::milliseconds( 5 ) );
+    thread( [ & ]() {
+        for ( int i = 0; i < 32; i++ ) {
+            mutex.lock_shared();
+            mutex.unlock_shared();
+        }
+    } ).join();
+
+    atomic< bool > written = false;
+    thread         writer( [ & ]() {
+        unique_lock< ScalableSharedMutex > lock( mutex );
+        written = true;
+    } );
+    // 只有写者在等待时 try_lock_shared 才会失败
+    bool acquired = true;
+    for ( int i = 0; i < 1000 && acquired; i++ ) {
+        this_thread::sleep_for( chrono::milliseconds( 1 ) );
+        thread( [ & ]() {
+            acquired = mutex.try_lock_shared();
+            if ( acquired ) {
+                mutex.unlock_shared();
+            }
+        } ).join();
+    }
+    ASSERT( !acquired );
+    atomic< bool > read = false;
+    thread         reader( [ & ]() {
+        shared_lock< ScalableSharedMutex > lock( mutex );
+        read = true;
+        ASSERT( written );
+    } );
+    this_thread::sleep_for( chrono::milliseconds( 20 ) );
+    ASSERT( !read );
+    ASSERT( !written );
+    mutex.unlock_shared();
+    writer.join();
+    reader.join();
+    ASSERT( written );
+
+    // try_lock 与读偏置的读者互斥，失败时不影响读偏置的读者
+    ScalableSharedMutex try_mutex;
+    try_mutex.lock_shared();
+    thread( [ & ]() {
+        bool locked = try_mutex.try_lock();
+        ASSERT( !locked );
+    } ).join();
+    try_mutex.unlock_shared();
+    bool locked = try_mutex.try_lock();
+    ASSERT( locked );
+    thread( [ & ]() {
+        bool shared = try_mutex.try_lock_shared();
+        ASSERT( !shared );
+    } ).join();
+    try_mutex.unlock();
+}
+vector< u8 > to_bytes( const string &str ) {
+    return vector< u8 >( str.begin(), str.end() );
+}
+
+void test_data_file_write_and_read() {
+    string dir_path = "../../../../tmp/test_data_file";
+    filesystem::create_directories( dir_path );
+    DataFile data_file( dir_path, 0 );
+
+    LogRecord    rec1{ to_bytes( "name" ), to_bytes( "bitcask-cpp" ),
+                    LogRecordType::NORMAL };
+    vector< u8 > enc1 = rec1.encode();
+    data_file.write( enc1 ).unwrap();
+
+    LogRecord    rec2{ to_bytes( "name" ), {}, LogRecordType::DELETED };
+    vector< u8 > enc2 = rec2.encode();
+    data_file.write( enc2 ).unwrap();
+    ASSERT_EQ( data_file.get_write_off(), enc1.size() + enc2.size() );
+
+    auto read1 = data_file.read_log_record( 0 ).unwrap();
+    ASSERT_EQ( read1.size, enc1.size() );
+    ASSERT( read1.record.key == rec1.key );
+    ASSERT( read1.record.value == rec1.value );
+    ASSERT_EQ( read1.record.rec_type, LogRecordType::NORMAL );
+
+    auto read2 = data_file.read_log_record( read1.size ).unwrap();
+    ASSERT_EQ( read2.size, enc2.size() );
+    ASSERT( read2.record.value.empty() );
+    ASSERT_EQ( read2.record.rec_type, LogRecordType::DELETED );
+
+    auto read3 = data_file.read_log_record( read1.size + read2.size );
+    ASSERT( read3.unwrap_err() == Errors::ReadDataFileEOF );
+
+    // 失效位图按记录序号标记，停用之后 merge 退回到查询索引
+    data_file.mark_dead( 1 );
+    data_file.mark_dead( 70 );
+    auto dead_map = data_file.get_dead_map().value();
+    ASSERT_EQ( dead_map[ 0 ], 2 );
+    ASSERT_EQ( dead_map[ 1 ], 1ull << 6 );
+    data_file.set_dead_map( { 1ull << 3 } );
+    ASSERT_EQ( data_file.get_dead_map().value()[ 0 ], 1ull << 3 );
+    data_file.disable_live_map();
+    ASSERT( !data_file.get_dead_map().has_value() );
+
+    // 在内核中拷贝与经过缓冲区拷贝的结果相同，记录可以原样读出
+    for ( bool zero_copy : { true, false } ) {
+        DataFile copy( dir_path, zero_copy ? 1 : 2 );
+        copy.write( enc2 ).unwrap();
+        u64 offset = copy.copy_from( data_file, 0, enc1.size(), zero_copy )
+                         .unwrap();
+        ASSERT_EQ( offset, enc2.size() );
+        ASSERT_EQ( copy.get_write_off(), enc1.size() + enc2.size() );
+        auto read = copy.read_log_record( offset ).unwrap();
+        ASSERT( read.record.value == rec1.value );
+    }
+
+    // 损坏的长度超出文件末尾时视为读到末尾，不按该长度分配缓冲区。
+    // 重新打开的文件在加载之前 write_off 为 0，同样以文件的长度为界
+    {
+        DataFile     corrupt( dir_path, 3 );
+        vector< u8 > bad = { 0, 0, 0, 0, 1, 1 };
+        for ( int i = 0; i < 2; i++ ) {
+            bad.insert( bad.end(), { 0xff, 0xff, 0xff, 0xff, 0x0f } );
+        }
+        corrupt.write( enc1 ).unwrap();
+        corrupt.write( bad ).unwrap();
+    }
+    DataFile reopened( dir_path, 3 );
+    auto     read_bad = reopened.read_log_record( enc1.size() );
+    ASSERT( read_bad.unwrap_err() == Errors::ReadDataFileEOF );
+    auto hints = build_hint_records( reopened ).unwrap();
+    ASSERT_EQ( hints.size(), 1 );
+
+    filesystem::remove_all( dir_path );
+}
+
+void test_engine_put_get_del() {
+    Options options;
+    options.dir_path       = "../../../../tmp/test_engine";
+    options.data_file_size = 256;
+    filesystem::remove_all( options.dir_path );
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int i = 0; i < 100; i++ ) {
+            auto res = engine->put( to_bytes( "key-" + to_string( i ) ),
+                                    to_bytes( "value-" + to_string( i ) ) );
+            ASSERT( res.is_ok() );
+        }
+        // 覆盖写和删除
+        engine->put( to_bytes( "key-1" ), to_bytes( "new-value" ) ).unwrap();
+        engine->del( to_bytes( "key-2" ) ).unwrap();
+
+        ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() ==
+                to_bytes( "new-value" ) );
+        ASSERT( engine->get( to_bytes( "key-2" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-99" ) ).unwrap() ==
+                to_bytes( "value-99" ) );
+        ASSERT( engine->put( {}, to_bytes( "v" ) ).unwrap_err() ==
+                Errors::KeyIsEmpty );
+    }
+
+    // 重新打开，从数据文件中恢复索引
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() ==
+                to_bytes( "new-value" ) );
+        ASSERT( engine->get( to_bytes( "key-2" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-50" ) ).unwrap() ==
+                to_bytes( "value-50" ) );
+        engine->put( to_bytes( "key-100" ), to_bytes( "value-100" ) ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-100" ) ).unwrap() ==
+                to_bytes( "value-100" ) );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_concurrent_get() {
+    Options options;
+    options.dir_path       = "../../../../tmp/test_engine_concurrent";
+    options.data_file_size = 4096;
+    filesystem::remove_all( options.dir_path );
+
+    auto engine = Engine::open( options ).unwrap();
+    for ( int i = 0; i < 100; i++ ) {
+        engine->put( to_bytes( "key-" + to_string( i ) ),
+                     to_bytes( "value-" + to_string( i ) ) );
+    }
+
+    // 一个写者不断追加并切换活跃文件，多个读者并发读取
+    atomic< bool >   failed = false;
+    vector< thread > threads;
+    threads.push_back( thread( [ & ]() {
+        for ( int i = 100; i < 2000; i++ ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         to_bytes( "value-" + to_string( i ) ) );
+        }
+    } ) );
+    for ( int t = 0; t < 4; t++ ) {
+        threads.push_back( thread( [ & ]() {
+            for ( int round = 0; round < 10; round++ ) {
+                for ( int i = 0; i < 100; i++ ) {
+                    auto key   = to_bytes( "key-" + to_string( i ) );
+                    auto value = to_bytes( "value-" + to_string( i ) );
+                    auto res   = engine->get( key );
+                    if ( res.is_err() || res.unwrap() != value ) {
+                        failed = true;
+                    }
+                }
+            }
+        } ) );
+    }
+    for ( auto &thread : threads ) {
+        thread.join();
+    }
+    ASSERT_EQ( failed.load(), false );
+
+    // 关闭引擎，等待后台线程写完 hint 文件之后再删除目录
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_concurrent_put() {
+    Options options;
+    options.dir_path       = "../../../../tmp/test_engine_concurrent_put";
+    options.data_file_size = 64 * 1024;
+    filesystem::remove_all( options.dir_path );
+
+    // 多个写者并行追加不同的 key，同时竞争写同一个 key
+    {
+        auto             engine = Engine::open( options ).unwrap();
+        vector< thread > threads;
+        for ( int t = 0; t < 8; t++ ) {
+            threads.push_back( thread( [ &engine, t ]() {
+                for ( int i = 0; i < 500; i++ ) {
+                    string suffix = to_string( t ) + "-" + to_string( i );
+                    engine->put( to_bytes( "key-" + suffix ),
+                                 to_bytes( "value-" + suffix ) );
+                    engine->put( to_bytes( "same-key" ), to_bytes( suffix ) );
+                }
+            } ) );
+        }
+        for ( auto &thread : threads ) {
+            thread.join();
+        }
+        ASSERT( engine->get( to_bytes( "key-7-499" ) ).unwrap() ==
+                to_bytes( "value-7-499" ) );
+        engine->put( to_bytes( "same-key" ), to_bytes( "last" ) ).unwrap();
+    }
+
+    // 重新打开之后所有数据都可以完整读出
+    {
+        auto engine = Engine::open( options ).unwrap();
+        bool all_ok = true;
+        for ( int t = 0; t < 8; t++ ) {
+            for ( int i = 0; i < 500; i++ ) {
+                string suffix = to_string( t ) + "-" + to_string( i );
+                auto   res    = engine->get( to_bytes( "key-" + suffix ) );
+                all_ok = all_ok && res.is_ok() &&
+                         res.unwrap() == to_bytes( "value-" + suffix );
+            }
+        }
+        ASSERT( all_ok );
+        ASSERT( engine->get( to_bytes( "same-key" ) ).unwrap() ==
+                to_bytes( "last" ) );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_multi_active_files() {
+    Options options;
+    options.dir_path        = "../../../../tmp/test_engine_multi_active";
+    options.data_file_size  = 16 * 1024;
+    options.active_file_num = 4;
+    filesystem::remove_all( options.dir_path );
+
+    {
+        auto             engine = Engine::open( options ).unwrap();
+        vector< thread > threads;
+        for ( int t = 0; t < 4; t++ ) {
+            threads.push_back( thread( [ &engine, t ]() {
+                for ( int i = 0; i < 1000; i++ ) {
+                    engine->put( to_bytes( "key-" + to_string( i ) ),
+                                 to_bytes( to_string( t ) ) );
+                }
+            } ) );
+        }
+        for ( auto &thread : threads ) {
+            thread.join();
+        }
+        // 在不同线程中覆盖写和删除，写入会落在不同的活跃文件
+        thread( [ &engine ]() {
+            engine->put( to_bytes( "key-1" ), to_bytes( "newest" ) ).unwrap();
+        } ).join();
+        thread( [ &engine ]() {
+            engine->del( to_bytes( "key-2" ) ).unwrap();
+        } ).join();
+        ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() ==
+                to_bytes( "newest" ) );
+    }
+
+    // 重新打开之后通过序列号恢复出最新的数据
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() ==
+                to_bytes( "newest" ) );
+        ASSERT( engine->get( to_bytes( "key-2" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-999" ) ).is_ok() );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_partitioned_engine() {
+    Options options;
+    options.dir_path = "../../../../tmp/test_partitioned_engine";
+    filesystem::remove_all( options.dir_path );
+
+    {
+        auto engine = PartitionedEngine::open( options, 4 ).unwrap();
+        for ( int i = 0; i < 200; i++ ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         to_bytes( "value-" + to_string( i ) ) );
+        }
+        engine->del( to_bytes( "key-0" ) ).unwrap();
+
+        // 批量读取的结果与请求顺序一致
+        auto values = engine->multi_get( { to_bytes( "key-10" ),
+                                           to_bytes( "key-0" ),
+                                           to_bytes( "key-199" ) } );
+        ASSERT_EQ( values.size(), 3 );
+        ASSERT( values[ 0 ].unwrap() == to_bytes( "value-10" ) );
+        ASSERT( values[ 1 ].unwrap_err() == Errors::KeyNotFound );
+        ASSERT( values[ 2 ].unwrap() == to_bytes( "value-199" ) );
+
+        // 跨分区的 key 全局有序
+        auto keys = engine->list_keys();
+        ASSERT_EQ( keys.size(), 199 );
+        ASSERT( is_sorted( keys.begin(), keys.end() ) );
+
+        u64 count = 0;
+        engine->fold( [ & ]( const vector< u8 > &key, const vector< u8 > & ) {
+            ASSERT( key == keys[ count ] );
+            return ++count < 10;
+        } );
+        ASSERT_EQ( count, 10 );
+
+        // 完整遍历时 key 与 value 对应，且与 list_keys 的顺序一致
+        count = 0;
+        engine->fold(
+            [ & ]( const vector< u8 > &key, const vector< u8 > &value ) {
+                string name( key.begin() + 4, key.end() );
+                ASSERT( key == keys[ count ] );
+                ASSERT( value == to_bytes( "value-" + name ) );
+                count++;
+                return true;
+            } );
+        ASSERT_EQ( count, 199 );
+
+        // 跨分区的范围、前缀以及反向遍历
+        auto scan = [ & ]( const IteratorOptions &iter_options ) {
+            vector< vector< u8 > > scanned;
+            engine
+                ->scan( iter_options,
+                        [ & ]( const vector< u8 > &key, const vector< u8 > & ) {
+                            scanned.push_back( key );
+                            return true;
+                        } )
+                .unwrap();
+            return scanned;
+        };
+        IteratorOptions iter_options;
+        iter_options.prefix = to_bytes( "key-1" );
+        auto prefixed       = scan( iter_options );
+        ASSERT_EQ( prefixed.size(), 111 );
+        ASSERT( is_sorted( prefixed.begin(), prefixed.end() ) );
+
+        iter_options.reverse = true;
+        auto reversed        = scan( iter_options );
+        ASSERT( equal( reversed.begin(), reversed.end(), prefixed.rbegin(),
+                       prefixed.rend() ) );
+
+        IteratorOptions bounds;
+        bounds.lower_bound = to_bytes( "key-150" );
+        bounds.upper_bound = to_bytes( "key-160" );
+        auto bounded       = scan( bounds );
+        ASSERT_EQ( bounded.size(), 11 );
+        ASSERT( bounded.front() == to_bytes( "key-150" ) );
+        ASSERT( bounded.back() == to_bytes( "key-16" ) );
+    }
+
+    // 分区数量与目录中记录的不一致时拒绝打开
+    {
+        auto res = PartitionedEngine::open( options, 8 );
+        ASSERT( res.unwrap_err() == Errors::PartitionNumMismatch );
+
+        auto engine = PartitionedEngine::open( options, 4 ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-10" ) ).unwrap() ==
+                to_bytes( "value-10" ) );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_merge() {
+    Options options;
+    options.dir_path       = "../../../../tmp/test_engine_merge";
+    options.data_file_size = 4096;
+    filesystem::remove_all( options.dir_path );
+
+    // 只统计数据文件，后台线程可能同时在创建和重命名 hint 文件
+    auto dir_size = [ & ]() {
+        u64 size = 0;
+        for ( auto &entry :
+              filesystem::directory_iterator( options.dir_path ) ) {
+            if ( entry.path().extension() == DATA_FILE_NAME_SUFFIX ) {
+                size += entry.file_size();
+            }
+        }
+        return size;
+    };
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        // 反复覆盖写，旧数据文件中大部分记录都是无效数据
+        for ( int round = 0; round < 10; round++ ) {
+            for ( int i = 0; i < 100; i++ ) {
+                engine->put( to_bytes( "key-" + to_string( i ) ),
+                             to_bytes( "value-" + to_string( round ) ) );
+            }
+        }
+        for ( int i = 0; i < 50; i++ ) {
+            engine->del( to_bytes( "key-" + to_string( i ) ) ).unwrap();
+        }
+
+        // merge 期间前台并发读写
+        u64            size_before = dir_size();
+        atomic< bool > failed      = false;
+        thread         reader( [ & ]() {
+            for ( int round = 0; round < 5; round++ ) {
+                for ( int i = 50; i < 100; i++ ) {
+                    auto key = to_bytes( "key-" + to_string( i ) );
+                    auto res = engine->get( key );
+                    if ( res.is_err() ||
+                         res.unwrap() != to_bytes( "value-9" ) ) {
+                        failed = true;
+                    }
+                }
+            }
+        } );
+        thread writer( [ & ]() {
+            for ( int i = 0; i < 100; i++ ) {
+                engine->put( to_bytes( "new-key-" + to_string( i ) ),
+                             to_bytes( "new-value" ) );
+            }
+        } );
+        ASSERT( engine->merge().is_ok() );
+        reader.join();
+        writer.join();
+        ASSERT_EQ( failed.load(), false );
+        ASSERT( dir_size() < size_before );
+
+        ASSERT( engine->get( to_bytes( "key-0" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-99" ) ).unwrap() ==
+                to_bytes( "value-9" ) );
+        ASSERT( engine->get( to_bytes( "new-key-99" ) ).unwrap() ==
+                to_bytes( "new-value" ) );
+    }
+
+    // 重新打开，merge 之后的数据文件可以恢复出相同的索引
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-0" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-99" ) ).unwrap() ==
+                to_bytes( "value-9" ) );
+        ASSERT_EQ( engine->list_keys().size(), 150 );
+    }
+
+    // 后台 merge 线程定期执行，析构时正常退出
+    {
+        options.merge_interval_ms   = 10;
+        options.merge_bytes_per_sec = 1024 * 1024;
+        auto engine                 = Engine::open( options ).unwrap();
+        for ( int i = 0; i < 100; i++ ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         to_bytes( "value-9" ) );
+        }
+        this_thread::sleep_for( chrono::milliseconds( 50 ) );
+        ASSERT( engine->get( to_bytes( "key-0" ) ).unwrap() ==
+                to_bytes( "value-9" ) );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_merge_active_file() {
+    Options options;
+    options.dir_path            = "../../../../tmp/test_merge_active_file";
+    options.data_file_size      = 1024;
+    options.merge_garbage_ratio = 0;
+    filesystem::remove_all( options.dir_path );
+
+    auto data_file_ids = [ & ]() {
+        vector< u32 > ids;
+        for ( auto &entry :
+              filesystem::directory_iterator( options.dir_path ) ) {
+            if ( entry.path().extension() == DATA_FILE_NAME_SUFFIX ) {
+                ids.push_back( stoul( entry.path().stem().string() ) );
+            }
+        }
+        sort( ids.begin(), ids.end() );
+        return ids;
+    };
+
+    // merge 输出文件的 id 比活跃文件大
+    u32 active_id = 0;
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int round = 0; round < 3; round++ ) {
+            for ( int i = 0; i < 50; i++ ) {
+                engine->put( to_bytes( "key-" + to_string( i ) ),
+                             to_bytes( "value-" + to_string( round ) ) );
+            }
+        }
+        active_id = data_file_ids().back();
+        ASSERT( engine->merge().is_ok() );
+    }
+    vector< u32 > outputs;
+    for ( u32 file_id : data_file_ids() ) {
+        if ( file_id > active_id ) {
+            outputs.push_back( file_id );
+        }
+    }
+    ASSERT( !outputs.empty() );
+
+    // 重新打开之后原来的活跃文件继续写入，merge 输出文件保持不变
+    auto output_size = [ & ]( u32 file_id ) {
+        return filesystem::file_size(
+            DataFile::get_data_file_name( options.dir_path, file_id ) );
+    };
+    vector< u64 > sizes;
+    for ( u32 file_id : outputs ) {
+        sizes.push_back( output_size( file_id ) );
+    }
+    for ( int reopen = 0; reopen < 2; reopen++ ) {
+        auto engine = Engine::open( options ).unwrap();
+        engine->put( to_bytes( "new-key-" + to_string( reopen ) ),
+                     to_bytes( "new-value" ) );
+        for ( int i = 0; i < 50; i++ ) {
+            ASSERT( engine->get( to_bytes( "key-" + to_string( i ) ) )
+                        .unwrap() == to_bytes( "value-2" ) );
+        }
+        ASSERT_EQ( engine->list_keys().size(), 50 + reopen + 1 );
+    }
+    for ( u64 i = 0; i < outputs.size(); i++ ) {
+        bool has_hint = filesystem::exists(
+            get_hint_file_name( options.dir_path, outputs[ i ] ) );
+        ASSERT( has_hint );
+        ASSERT_EQ( output_size( outputs[ i ] ), sizes[ i ] );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_selective_merge() {
+    Options options;
+    options.dir_path            = "../../../../tmp/test_engine_selective_merge";
+    options.data_file_size      = 4096;
+    options.merge_garbage_ratio = 0.5;
+    filesystem::remove_all( options.dir_path );
+
+    auto first_file = DataFile::get_data_file_name( options.dir_path, 0 );
+    auto value      = to_bytes( string( 100, 'v' ) );
+    {
+        auto engine = Engine::open( options ).unwrap();
+        // 只写一次的冷数据集中在前面的文件中，之后反复覆盖写少量热数据
+        for ( int i = 0; i < 200; i++ ) {
+            engine->put( to_bytes( "cold-" + to_string( i ) ), value );
+        }
+        for ( int round = 0; round < 50; round++ ) {
+            for ( int i = 0; i < 20; i++ ) {
+                engine->put( to_bytes( "hot-" + to_string( i ) ), value );
+            }
+        }
+        for ( int i = 0; i < 10; i++ ) {
+            engine->del( to_bytes( "hot-" + to_string( i ) ) ).unwrap();
+        }
+
+        // 只有无效数据较多的文件参与 merge，冷数据文件保持不变
+        auto file_num = [ & ]() {
+            auto iter = filesystem::directory_iterator( options.dir_path );
+            return count_if( begin( iter ), end( iter ), []( auto &entry ) {
+                return entry.path().extension() == DATA_FILE_NAME_SUFFIX;
+            } );
+        };
+        auto num_before = file_num();
+        ASSERT( engine->merge().is_ok() );
+        ASSERT( filesystem::exists( first_file ) );
+        ASSERT( file_num() < num_before );
+        ASSERT( engine->get( to_bytes( "cold-0" ) ).unwrap() == value );
+        ASSERT( engine->get( to_bytes( "hot-19" ) ).unwrap() == value );
+        ASSERT( engine->get( to_bytes( "hot-0" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+    }
+
+    // 重新打开时重新统计无效数据
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT( engine->merge().is_ok() );
+        ASSERT( filesystem::exists( first_file ) );
+        ASSERT_EQ( engine->list_keys().size(), 210 );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_hint_file() {
+    Options options;
+    options.dir_path       = "../../../../tmp/test_engine_hint_file";
+    options.data_file_size = 4096;
+    filesystem::remove_all( options.dir_path );
+
+    auto count_files = [ & ]( string_view suffix ) {
+        auto iter = filesystem::directory_iterator( options.dir_path );
+        return count_if( begin( iter ), end( iter ), [ & ]( auto &entry ) {
+            return entry.path().extension() == suffix;
+        } );
+    };
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int round = 0; round < 5; round++ ) {
+            for ( int i = 0; i < 100; i++ ) {
+                engine->put( to_bytes( "key-" + to_string( i ) ),
+                             to_bytes( "value-" + to_string( round ) ) );
+            }
+        }
+        engine->del( to_bytes( "key-0" ) ).unwrap();
+    }
+
+    // 关闭时后台线程为所有写满的数据文件生成 hint 文件，只有活跃文件没有
+    ASSERT_EQ( count_files( HINT_FILE_NAME_SUFFIX ),
+               count_files( DATA_FILE_NAME_SUFFIX ) - 1 );
+    auto records = read_hint_file( options.dir_path, 0 ).unwrap();
+    ASSERT( records[ 0 ].key == to_bytes( "key-0" ) );
+    ASSERT_EQ( records[ 0 ].pos.offset, 0 );
+
+    // 通过 hint 文件重建索引，merge 的输出文件同样带有 hint 文件
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-0" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-99" ) ).unwrap() ==
+                to_bytes( "value-4" ) );
+        ASSERT( engine->merge().is_ok() );
+    }
+    ASSERT_EQ( count_files( HINT_FILE_NAME_SUFFIX ),
+               count_files( DATA_FILE_NAME_SUFFIX ) - 1 );
+
+    // hint 文件损坏时退回到读取数据文件
+    for ( auto &entry : filesystem::directory_iterator( options.dir_path ) ) {
+        if ( entry.path().extension() == HINT_FILE_NAME_SUFFIX ) {
+            filesystem::resize_file( entry.path(), entry.file_size() - 1 );
+        }
+    }
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-0" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-50" ) ).unwrap() ==
+                to_bytes( "value-4" ) );
+        ASSERT_EQ( engine->list_keys().size(), 99 );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_parallel_load() {
+    Options options;
+    options.dir_path        = "../../../../tmp/test_engine_parallel_load";
+    options.data_file_size  = 4096;
+    options.active_file_num = 2;
+    filesystem::remove_all( options.dir_path );
+
+    {
+        auto             engine = Engine::open( options ).unwrap();
+        vector< thread > threads;
+        for ( int t = 0; t < 2; t++ ) {
+            threads.push_back( thread( [ &engine, t ]() {
+                for ( int round = 0; round < 5; round++ ) {
+                    for ( int i = 0; i < 200; i++ ) {
+                        engine->put( to_bytes( "key-" + to_string( i ) ),
+                                     to_bytes( to_string( t ) + "-" +
+                                               to_string( round ) ) );
+                    }
+                }
+            } ) );
+        }
+        for ( auto &thread : threads ) {
+            thread.join();
+        }
+        for ( int i = 0; i < 200; i += 3 ) {
+            engine->del( to_bytes( "key-" + to_string( i ) ) ).unwrap();
+        }
+        engine->put( to_bytes( "key-0" ), to_bytes( "last" ) ).unwrap();
+    }
+
+    // 单线程与多线程重建出的索引完全一致
+    auto dump = [ & ]( u32 threads ) {
+        options.index_load_threads = threads;
+        auto engine                = Engine::open( options ).unwrap();
+
+        vector< pair< vector< u8 >, vector< u8 > > > data;
+        engine->fold( [ & ]( const vector< u8 > &key,
+                             const vector< u8 > &value ) {
+            data.emplace_back( key, value );
+            return true;
+        } );
+        return data;
+    };
+    auto serial   = dump( 1 );
+    auto parallel = dump( 8 );
+    ASSERT_EQ( serial.size(), 134 );
+    ASSERT( serial == parallel );
+    ASSERT( serial[ 0 ].second == to_bytes( "last" ) );
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_checkpoint() {
+    Options options;
+    options.dir_path            = "../../../../tmp/test_engine_checkpoint";
+    options.data_file_size      = 1024;
+    options.merge_garbage_ratio = 0;
+    filesystem::remove_all( options.dir_path );
+
+    auto snapshot_path =
+        filesystem::path( options.dir_path ) / INDEX_SNAPSHOT_NAME;
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int i = 0; i < 100; i++ ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         to_bytes( "value-0" ) );
+        }
+        ASSERT( engine->checkpoint().is_ok() );
+
+        // 快照之后的写入: 覆盖、删除以及切换活跃文件
+        for ( int i = 0; i < 100; i += 2 ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         to_bytes( "value-1" ) );
+        }
+        engine->del( to_bytes( "key-1" ) ).unwrap();
+        engine->put( to_bytes( "key-new" ), to_bytes( "new" ) ).unwrap();
+    }
+    ASSERT( filesystem::exists( snapshot_path ) );
+
+    auto check = [ & ]( Engine &engine ) {
+        ASSERT( engine.get( to_bytes( "key-0" ) ).unwrap() ==
+                to_bytes( "value-1" ) );
+        ASSERT( engine.get( to_bytes( "key-3" ) ).unwrap() ==
+                to_bytes( "value-0" ) );
+        ASSERT( engine.get( to_bytes( "key-1" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine.get( to_bytes( "key-new" ) ).unwrap() ==
+                to_bytes( "new" ) );
+        ASSERT_EQ( engine.list_keys().size(), 100 );
+    };
+
+    // 从快照恢复索引，只重放快照之后的数据
+    {
+        auto engine = Engine::open( options ).unwrap();
+        check( *engine );
+    }
+
+    // 快照损坏时退回到读取 hint 文件和数据文件
+    filesystem::resize_file( snapshot_path,
+                             filesystem::file_size( snapshot_path ) - 1 );
+    ASSERT( read_index_snapshot( options.dir_path ).unwrap_err() ==
+            Errors::IndexSnapshotCorrupted );
+    {
+        auto engine = Engine::open( options ).unwrap();
+        check( *engine );
+
+        // merge 会改变记录的位置，旧的快照随之失效，merge 成功之后重新生成
+        ASSERT( engine->checkpoint().is_ok() );
+        ASSERT( engine->merge().is_ok() );
+        ASSERT( read_index_snapshot( options.dir_path ).is_ok() );
+        check( *engine );
+    }
+    {
+        auto engine = Engine::open( options ).unwrap();
+        check( *engine );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_checkpoint_merge() {
+    Options options;
+    options.dir_path            = "../../../../tmp/test_checkpoint_merge";
+    options.data_file_size      = 1024;
+    options.merge_garbage_ratio = 0;
+    filesystem::remove_all( options.dir_path );
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int i = 0; i < 100; i++ ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         to_bytes( "value-0" ) );
+        }
+        ASSERT( engine->checkpoint().is_ok() );
+        for ( int i = 0; i < 100; i += 2 ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         to_bytes( "value-1" ) );
+        }
+    }
+
+    // 快照记录每条记录在文件中的序号以及每个文件已经分配的序号数量
+    auto snapshot = read_index_snapshot( options.dir_path ).unwrap();
+    for ( const auto &file : snapshot.files ) {
+        DataFile data_file( options.dir_path, file.file_id );
+        auto     records = build_hint_records( data_file ).unwrap();
+        u64      covered = count_if(
+            records.begin(), records.end(), [ & ]( const auto &record ) {
+                return record.pos.offset < file.watermark;
+            } );
+        ASSERT_EQ( file.slot_num, covered );
+        for ( const auto &[ key, pos ] : snapshot.entries ) {
+            if ( pos.file_id != file.file_id ) {
+                continue;
+            }
+            auto iter = find_if(
+                records.begin(), records.end(), [ & ]( const auto &record ) {
+                    return record.pos.offset == pos.offset;
+                } );
+            ASSERT( iter != records.end() && iter->pos.slot == pos.slot );
+        }
+    }
+
+    auto check = [ & ]( Engine &engine ) {
+        for ( int i = 0; i < 100; i++ ) {
+            string value = i % 2 == 0 ? "value-1"
+                           : i < 20   ? "value-2"
+                                      : "value-0";
+            ASSERT( engine.get( to_bytes( "key-" + to_string( i ) ) )
+                        .unwrap() == to_bytes( value ) );
+        }
+    };
+
+    // 从快照恢复之后失效位图仍然可用: 重放时被覆盖的快照记录与打开之后
+    // 被覆盖的快照记录都按原有的序号标记失效，merge 据此跳过，
+    // 序号错误时仍然有效的记录会被丢弃
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int i = 1; i < 20; i += 2 ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         to_bytes( "value-2" ) );
+        }
+        ASSERT( engine->merge().is_ok() );
+        check( *engine );
+    }
+
+    // merge 之后重新生成快照，其中不再包含已经删除的输入文件
+    auto merged = read_index_snapshot( options.dir_path );
+    ASSERT( merged.is_ok() );
+    for ( const auto &file : merged.unwrap().files ) {
+        bool exists = filesystem::exists(
+            DataFile::get_data_file_name( options.dir_path, file.file_id ) );
+        ASSERT( exists );
+    }
+    {
+        auto engine = Engine::open( options ).unwrap();
+        check( *engine );
+        ASSERT_EQ( engine->list_keys().size(), 100 );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_lazy_index_load() {
+    Options options;
+    options.dir_path       = "../../../../tmp/test_engine_lazy_index_load";
+    options.data_file_size = 1024;
+    filesystem::remove_all( options.dir_path );
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int round = 0; round < 3; round++ ) {
+            for ( int i = 0; i < 200; i++ ) {
+                engine->put( to_bytes( "key-" + to_string( i ) ),
+                             to_bytes( "value-" + to_string( round ) ) );
+            }
+        }
+        engine->del( to_bytes( "key-0" ) ).unwrap();
+    }
+
+    // key 摘要中包含文件中的全部 key
+    auto records = read_hint_file( options.dir_path, 0 ).unwrap();
+    auto summary = read_key_summary( options.dir_path, 0 ).unwrap();
+    for ( const auto &record : records ) {
+        ASSERT( summary.may_contain( record.key ) );
+        ASSERT( summary.max_seq_no >= record.seq_no );
+    }
+    ASSERT( !summary.may_contain( to_bytes( "not-exist" ) ) );
+
+    // 索引尚未加载完成时即可读写，未加载的文件中的 key 同样可以读到
+    options.lazy_index_load = true;
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-7" ) ).unwrap() ==
+                to_bytes( "value-2" ) );
+        ASSERT( engine->get( to_bytes( "key-0" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        engine->put( to_bytes( "key-1" ), to_bytes( "new" ) ).unwrap();
+        engine->del( to_bytes( "key-2" ) ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() ==
+                to_bytes( "new" ) );
+        ASSERT( engine->get( to_bytes( "key-2" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+
+        // 后台加载的旧记录不会覆盖打开之后的写入
+        ASSERT_EQ( engine->list_keys().size(), 198 );
+        ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() ==
+                to_bytes( "new" ) );
+    }
+
+    options.lazy_index_load = false;
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT_EQ( engine->list_keys().size(), 198 );
+        ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() ==
+                to_bytes( "new" ) );
+        ASSERT( engine->get( to_bytes( "key-2" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-199" ) ).unwrap() ==
+                to_bytes( "value-2" ) );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_crash_recovery() {
+    Options options;
+    options.dir_path = "../../../../tmp/test_engine_crash_recovery";
+    filesystem::remove_all( options.dir_path );
+
+    auto data_path     = DataFile::get_data_file_name( options.dir_path, 0 );
+    auto manifest_path =
+        filesystem::path( options.dir_path ) / SYNC_MANIFEST_NAME;
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int i = 0; i < 100; i++ ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         to_bytes( "value-" + to_string( i ) ) );
+        }
+    }
+    ASSERT( filesystem::exists( manifest_path ) );
+    u64 synced_size = filesystem::file_size( data_path );
+
+    // 末尾有一条写了一半的记录，打开时截断
+    {
+        FileIO       file_io( data_path );
+        vector< u8 > torn = { 0x12, 0x34, 0x56, 0x78, 0x00, 0x7f, 0x05 };
+        file_io.write( torn );
+    }
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT_EQ( filesystem::file_size( data_path ), synced_size );
+        ASSERT_EQ( engine->list_keys().size(), 100 );
+        engine->put( to_bytes( "key-new" ), to_bytes( "new" ) ).unwrap();
+    }
+
+    // 没有持久化记录时从头校验，最后一条记录损坏时截断该记录
+    filesystem::remove( manifest_path );
+    u64 size = filesystem::file_size( data_path );
+    {
+        FileIO       file_io( data_path );
+        vector< u8 > last( 1 );
+        file_io.read( last, size - 1 );
+        last[ 0 ] ^= 0xff;
+        file_io.write_at( last, size - 1 );
+    }
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT_EQ( filesystem::file_size( data_path ), synced_size );
+        ASSERT( engine->get( to_bytes( "key-new" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-99" ) ).unwrap() ==
+                to_bytes( "value-99" ) );
+        engine->put( to_bytes( "key-new" ), to_bytes( "again" ) ).unwrap();
+    }
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT( engine->get( to_bytes( "key-new" ) ).unwrap() ==
+                to_bytes( "again" ) );
+        ASSERT_EQ( engine->list_keys().size(), 101 );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_parallel_merge() {
+    Options options;
+    options.dir_path            = "../../../../tmp/test_engine_parallel_merge";
+    options.data_file_size      = 1024;
+    options.merge_garbage_ratio = 0;
+    options.merge_threads       = 4;
+    filesystem::remove_all( options.dir_path );
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int round = 0; round < 3; round++ ) {
+            for ( int i = 0; i < 200; i++ ) {
+                engine->put( to_bytes( "key-" + to_string( i ) ),
+                             to_bytes( "value-" + to_string( round ) ) );
+            }
+        }
+        for ( int i = 0; i < 200; i += 2 ) {
+            engine->del( to_bytes( "key-" + to_string( i ) ) ).unwrap();
+        }
+
+        // 多个工作线程各自写入输出文件，merge 期间前台继续写入
+        thread writer( [ & ]() {
+            for ( int i = 1; i < 200; i += 4 ) {
+                engine->put( to_bytes( "key-" + to_string( i ) ),
+                             to_bytes( "new" ) );
+            }
+        } );
+        ASSERT( engine->merge().is_ok() );
+        writer.join();
+    }
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT_EQ( engine->list_keys().size(), 100 );
+        ASSERT( engine->get( to_bytes( "key-0" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() ==
+                to_bytes( "new" ) );
+        ASSERT( engine->get( to_bytes( "key-3" ) ).unwrap() ==
+                to_bytes( "value-2" ) );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_value_cache() {
+    // 热点数据被访问多次之后，一次性的扫描不会把它们挤出缓存
+    {
+        ValueCache   cache( 64 * 1024 );
+        vector< u8 > value( 100, 'v' );
+        for ( int round = 0; round < 5; round++ ) {
+            for ( u32 i = 0; i < 100; i++ ) {
+                if ( !cache.get( LogRecordPos( 1, i ) ).has_value() ) {
+                    cache.put( LogRecordPos( 1, i ), value );
+                }
+            }
+        }
+        for ( u32 i = 0; i < 10000; i++ ) {
+            if ( !cache.get( LogRecordPos( 2, i ) ).has_value() ) {
+                cache.put( LogRecordPos( 2, i ), value );
+            }
+        }
+        int hits = 0;
+        for ( u32 i = 0; i < 100; i++ ) {
+            hits += cache.get( LogRecordPos( 1, i ) ).has_value();
+        }
+        ASSERT( hits >= 95 );
+        ASSERT( cache.stats().bytes <= 64 * 1024 );
+    }
+
+    Options options;
+    options.dir_path            = "../../../../tmp/test_engine_value_cache";
+    options.data_file_size      = 1024;
+    options.merge_garbage_ratio = 0;
+    options.value_cache_bytes   = 1024 * 1024;
+    filesystem::remove_all( options.dir_path );
+
+    auto engine = Engine::open( options ).unwrap();
+    for ( int i = 0; i < 100; i++ ) {
+        engine->put( to_bytes( "key-" + to_string( i ) ),
+                     to_bytes( "value-" + to_string( i ) ) );
+    }
+    auto first  = engine->get( to_bytes( "key-1" ) ).unwrap();
+    auto second = engine->get( to_bytes( "key-1" ) ).unwrap();
+    ASSERT( first == to_bytes( "value-1" ) );
+    ASSERT( second == to_bytes( "value-1" ) );
+    ASSERT_EQ( engine->cache_stats().hits, 1 );
+    ASSERT_EQ( engine->cache_stats().misses, 1 );
+
+    // 覆盖、删除以及 merge 之后索引指向新的位置，不会读到旧的缓存
+    engine->put( to_bytes( "key-1" ), to_bytes( "new" ) ).unwrap();
+    ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() == to_bytes( "new" ) );
+    engine->get( to_bytes( "key-2" ) ).unwrap();
+    engine->del( to_bytes( "key-2" ) ).unwrap();
+    ASSERT( engine->get( to_bytes( "key-2" ) ).unwrap_err() ==
+            Errors::KeyNotFound );
+    for ( int i = 0; i < 100; i++ ) {
+        engine->get( to_bytes( "key-" + to_string( i ) ) );
+    }
+    ASSERT( engine->merge().is_ok() );
+    for ( int i = 3; i < 100; i++ ) {
+        ASSERT( engine->get( to_bytes( "key-" + to_string( i ) ) ).unwrap() ==
+                to_bytes( "value-" + to_string( i ) ) );
+    }
+    ASSERT( engine->get( to_bytes( "key-1" ) ).unwrap() == to_bytes( "new" ) );
+    ASSERT( engine->cache_stats().hits > 1 );
+
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_inline_value() {
+    Options options;
+    options.dir_path          = "../../../../tmp/test_engine_inline_value";
+    options.inline_value_size = 256;
+    filesystem::remove_all( options.dir_path );
+    ASSERT( Engine::open( options ).unwrap_err() ==
+            Errors::InlineValueSizeIsInvalid );
+
+    options.inline_value_size = 8;
+    options.value_cache_bytes = 1024 * 1024;
+    options.data_file_size    = 1024;
+    {
+        auto engine = Engine::open( options ).unwrap();
+        engine->put( to_bytes( "counter" ), to_bytes( "1" ) ).unwrap();
+        engine->put( to_bytes( "large" ), vector< u8 >( 100, 'v' ) ).unwrap();
+        ASSERT_EQ( engine->inline_value_bytes(), 2 );
+
+        // 内联的 value 直接从索引返回，不经过缓存也不读取数据文件
+        auto value = engine->get( to_bytes( "counter" ) ).unwrap();
+        ASSERT( value == to_bytes( "1" ) );
+        ASSERT_EQ( engine->cache_stats().misses, 0 );
+
+        // 覆盖为大 value 或删除之后释放内联的内存
+        engine->put( to_bytes( "counter" ), vector< u8 >( 20, 'x' ) ).unwrap();
+        ASSERT_EQ( engine->inline_value_bytes(), 0 );
+        engine->put( to_bytes( "counter" ), to_bytes( "42" ) ).unwrap();
+        ASSERT_EQ( engine->inline_value_bytes(), 3 );
+        engine->put( to_bytes( "flag" ), to_bytes( "y" ) ).unwrap();
+        engine->del( to_bytes( "flag" ) ).unwrap();
+        ASSERT_EQ( engine->inline_value_bytes(), 3 );
+
+        // merge 移动记录时保留内联的 value
+        for ( int i = 0; i < 50; i++ ) {
+            engine->put( to_bytes( "key-" + to_string( i ) ),
+                         vector< u8 >( 50, 'v' ) );
+        }
+        ASSERT( engine->merge().is_ok() );
+        ASSERT_EQ( engine->inline_value_bytes(), 3 );
+    }
+
+    // 从 hint 文件加载的 key 第一次读取之后内联
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT_EQ( engine->inline_value_bytes(), 0 );
+        auto first = engine->get( to_bytes( "counter" ) ).unwrap();
+        ASSERT( first == to_bytes( "42" ) );
+        ASSERT_EQ( engine->inline_value_bytes(), 3 );
+        auto large = engine->get( to_bytes( "large" ) ).unwrap();
+        ASSERT( large == vector< u8 >( 100, 'v' ) );
+        ASSERT_EQ( engine->inline_value_bytes(), 3 );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_multi_get() {
+    Options options;
+    options.dir_path          = "../../../../tmp/test_engine_multi_get";
+    options.data_file_size    = 4096;
+    options.inline_value_size = 4;
+    filesystem::remove_all( options.dir_path );
+
+    auto engine   = Engine::open( options ).unwrap();
+    auto value_of = []( int i, int round ) {
+        // 一部分 value 足够小，内联在索引中
+        return to_bytes( string( i % 7, 'v' ) + to_string( round ) );
+    };
+    for ( int round = 0; round < 2; round++ ) {
+        for ( int i = 0; i < 500; i++ ) {
+            if ( round == 0 || i % 3 == 0 ) {
+                engine->put( to_bytes( "key-" + to_string( i ) ),
+                             value_of( i, round ) );
+            }
+        }
+    }
+    for ( int i = 0; i < 500; i += 5 ) {
+        engine->del( to_bytes( "key-" + to_string( i ) ) ).unwrap();
+    }
+
+    // 乱序、重复、不存在以及空的 key
+    vector< vector< u8 > > keys;
+    for ( int i = 499; i >= 0; i-- ) {
+        keys.push_back( to_bytes( "key-" + to_string( i * 7 % 500 ) ) );
+    }
+    keys.push_back( to_bytes( "key-1" ) );
+    keys.push_back( to_bytes( "missing" ) );
+    keys.push_back( vector< u8 >() );
+
+    for ( int pass = 0; pass < 2; pass++ ) {
+        auto values = engine->multi_get( keys );
+        ASSERT_EQ( values.size(), keys.size() );
+        u64 matched = 0;
+        for ( u64 i = 0; i + 1 < keys.size(); i++ ) {
+            auto expected = engine->get( keys[ i ] );
+            matched += values[ i ].is_ok() == expected.is_ok() &&
+                       ( expected.is_err() ||
+                         values[ i ].unwrap() == expected.unwrap() );
+        }
+        ASSERT_EQ( matched, keys.size() - 1 );
+        ASSERT( values.back().unwrap_err() == Errors::KeyIsEmpty );
+        ASSERT( values[ 0 ].unwrap() == value_of( 493, 0 ) );
+        ASSERT( values[ 500 ].unwrap() == value_of( 1, 0 ) );
+
+        // 第二轮在 merge 移动记录之后读取
+        ASSERT( engine->merge().is_ok() );
+    }
+
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_seq_lock() {
+    // 多个写者同时修改，读者总是看到一致的三个字段
+    struct Triple {
+        u64 a = 0;
+        u64 b = 0;
+        u32 c = 0;
+    };
+    SeqLock< Triple > seq_lock;
+    const u64         UPDATES_PER_THREAD = 5000;
+    atomic< bool >    done               = false;
+    atomic< bool >    torn               = false;
 
-    std::thread t1( [ & ]() {
-        auto readguard = rwlock.read();
-        int  i         = 1000;
-        // 读取data
-        while ( i-- ) {
-            std::cout << "read data: " << data << std::endl;
+    thread reader( [ & ]() {
+        while ( !done ) {
+            auto value = seq_lock.load();
+            if ( value.a != value.b || value.a != value.c ) {
+                torn = true;
+            }
         }
     } );
-    std::thread t2( [ & ]() {
-        auto writeguard = rwlock.write();
-        int  i          = 1000;
-        while ( i-- ) {
-            std::cout << "write data: " << data++ << std::endl;
+    vector< thread > writers;
+    for ( int t = 0; t < 4; t++ ) {
+        writers.emplace_back( [ & ]() {
+            for ( u64 i = 0; i < UPDATES_PER_THREAD; i++ ) {
+                seq_lock.update( []( Triple &value ) {
+                    value.a++;
+                    value.b++;
+                    value.c++;
+                } );
+            }
+        } );
+    }
+    for ( auto &t : writers ) {
+        t.join();
+    }
+    done = true;
+    reader.join();
+
+    ASSERT( !torn );
+    auto value = seq_lock.load();
+    ASSERT_EQ( value.a, 4 * UPDATES_PER_THREAD );
+    ASSERT_EQ( value.c, 4 * UPDATES_PER_THREAD );
+
+    seq_lock.store( Triple{ 7, 7, 7 } );
+    ASSERT_EQ( seq_lock.load().b, 7 );
+}
+
+void test_timer_wheel() {
+    // 覆盖各层的边界以及超出最高层范围的定时项
+    u64               start = 1000;
+    u64               far   = 1ull << 25;
+    TimerWheel< u64 > wheel( start );
+    vector< u64 >     ticks = { start - 5,      start + 1,    start + 63,
+                                start + 64,     start + 4095, start + 4096,
+                                start + 300000, far,          far + 1 };
+    for ( u64 tick : ticks ) {
+        wheel.add( tick, tick );
+    }
+    ASSERT_EQ( wheel.size(), ticks.size() );
+
+    // 每次推进一段，到期的定时项恰好是 tick 不超过当前时间的那些
+    vector< u64 > fired;
+    bool          on_time = true;
+    for ( u64 now = start; now <= far + 1; now += 7 ) {
+        vector< u64 > expired;
+        wheel.advance( now, expired );
+        for ( u64 tick : expired ) {
+            on_time = on_time && tick <= now && tick + 7 > now;
+            fired.push_back( tick );
+        }
+    }
+    wheel.advance( far + 8, fired );
+    ASSERT( on_time );
+    ASSERT_EQ( wheel.size(), 0 );
+    sort( fired.begin(), fired.end() );
+    sort( ticks.begin(), ticks.end() );
+    ASSERT( fired == ticks );
+}
+
+void test_btree_iterator() {
+    BTree bt;
+    auto  key_of = []( int i ) {
+        char buf[ 16 ];
+        snprintf( buf, sizeof( buf ), "key-%03d", i );
+        return to_bytes( buf );
+    };
+    for ( int i = 0; i < 1000; i++ ) {
+        bt.put( key_of( i ), LogRecordPos( 1, i ) );
+    }
+
+    auto collect = [ & ]( const IteratorOptions &options ) {
+        vector< vector< u8 > > keys;
+        for ( auto iter = bt.iterator( options ); iter->valid();
+              iter->next() ) {
+            keys.push_back( iter->key() );
         }
+        return keys;
+    };
+
+    // 超过一批的数据，正向和反向都按顺序返回
+    IteratorOptions options;
+    auto            keys = collect( options );
+    ASSERT_EQ( keys.size(), 1000 );
+    ASSERT( is_sorted( keys.begin(), keys.end() ) );
+    options.reverse = true;
+    keys            = collect( options );
+    ASSERT_EQ( keys.size(), 1000 );
+    ASSERT( keys.front() == key_of( 999 ) );
+    ASSERT( is_sorted( keys.rbegin(), keys.rend() ) );
+
+    // 前缀以及范围
+    options.prefix = to_bytes( "key-12" );
+    keys           = collect( options );
+    ASSERT_EQ( keys.size(), 10 );
+    ASSERT( keys.front() == key_of( 129 ) );
+    options.prefix.clear();
+    options.lower_bound = key_of( 100 );
+    options.upper_bound = key_of( 200 );
+    keys                = collect( options );
+    ASSERT_EQ( keys.size(), 100 );
+    ASSERT( keys.front() == key_of( 199 ) );
+    options.reverse = false;
+    options.prefix  = to_bytes( "key-1" );
+    keys            = collect( options );
+    ASSERT_EQ( keys.size(), 100 );
+    ASSERT( keys.front() == key_of( 100 ) );
+
+    // seek 定位到第一个不小于 (反向时不大于) 目标的 key
+    auto iter = bt.iterator( IteratorOptions() );
+    iter->seek( to_bytes( "key-5005" ) );
+    ASSERT( iter->valid() && iter->key() == key_of( 501 ) );
+    ASSERT_EQ( iter->entry().pos.offset, 501 );
+    IteratorOptions reverse_options;
+    reverse_options.reverse = true;
+    iter                    = bt.iterator( reverse_options );
+    iter->seek( to_bytes( "key-5005" ) );
+    ASSERT( iter->valid() && iter->key() == key_of( 500 ) );
+    iter->rewind();
+    ASSERT( iter->key() == key_of( 999 ) );
+
+    // 全为 0xff 的前缀没有上界
+    bt.put( vector< u8 >{ 0xff, 0xff }, LogRecordPos( 1, 0 ) );
+    bt.put( vector< u8 >{ 0xff, 0xff, 0x01 }, LogRecordPos( 1, 0 ) );
+    IteratorOptions ff_options;
+    ff_options.prefix = vector< u8 >{ 0xff };
+    ASSERT_EQ( collect( ff_options ).size(), 2 );
+}
+
+void test_engine_scan() {
+    Options options;
+    options.dir_path          = "../../../../tmp/test_engine_scan";
+    options.data_file_size    = 4096;
+    options.inline_value_size = 2;
+    filesystem::remove_all( options.dir_path );
+
+    auto engine = Engine::open( options ).unwrap();
+    for ( int i = 0; i < 300; i++ ) {
+        engine->put( to_bytes( "user-" + to_string( 1000 + i ) ),
+                     to_bytes( to_string( i ) ) );
+        engine->put( to_bytes( "item-" + to_string( 1000 + i ) ),
+                     to_bytes( "value-" + to_string( i ) ) );
+    }
+    for ( int i = 0; i < 300; i += 10 ) {
+        engine->del( to_bytes( "user-" + to_string( 1000 + i ) ) ).unwrap();
+    }
+
+    // 前缀遍历跨越多批预读，值与 get 一致
+    IteratorOptions scan_options;
+    scan_options.prefix = to_bytes( "user-" );
+    int  count          = 0;
+    bool match          = true;
+    auto res            = engine->scan(
+        scan_options,
+        [ & ]( const vector< u8 > &key, const vector< u8 > &value ) {
+            count++;
+            match = match && engine->get( key ).unwrap() == value;
+            return true;
+        } );
+    ASSERT( res.is_ok() );
+    ASSERT_EQ( count, 270 );
+    ASSERT( match );
+
+    // 反向遍历范围，fn 返回 false 时提前结束
+    scan_options.prefix.clear();
+    scan_options.reverse     = true;
+    scan_options.upper_bound = to_bytes( "item-1100" );
+    vector< vector< u8 > > keys;
+    engine->scan( scan_options, [ & ]( const vector< u8 > &key,
+                                       const vector< u8 > & ) {
+        keys.push_back( key );
+        return keys.size() < 5;
     } );
+    ASSERT_EQ( keys.size(), 5 );
+    ASSERT( keys.front() == to_bytes( "item-1099" ) );
+    ASSERT( keys.back() == to_bytes( "item-1095" ) );
+
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_snapshot() {
+    Options options;
+    options.dir_path            = "../../../../tmp/test_engine_snapshot";
+    options.data_file_size      = 4096;
+    options.merge_garbage_ratio = 0;
+    filesystem::remove_all( options.dir_path );
+
+    auto engine = Engine::open( options ).unwrap();
+    for ( int i = 0; i < 200; i++ ) {
+        engine->put( to_bytes( "key-" + to_string( 1000 + i ) ),
+                     to_bytes( "old-" + to_string( i ) ) );
+    }
+    auto snapshot = engine->snapshot().unwrap();
+
+    // 快照之后的覆盖、删除和新写入对快照不可见
+    for ( int i = 0; i < 200; i++ ) {
+        auto key = to_bytes( "key-" + to_string( 1000 + i ) );
+        if ( i % 2 == 0 ) {
+            engine->put( key, to_bytes( "new-" + to_string( i ) ) );
+        } else {
+            engine->del( key );
+        }
+    }
+    engine->put( to_bytes( "key-9999" ), to_bytes( "new" ) );
+    ASSERT( snapshot->get( to_bytes( "key-1001" ) ).unwrap() ==
+            to_bytes( "old-1" ) );
+    ASSERT( snapshot->get( to_bytes( "key-1002" ) ).unwrap() ==
+            to_bytes( "old-2" ) );
+    ASSERT( snapshot->get( to_bytes( "key-9999" ) ).unwrap_err() ==
+            Errors::KeyNotFound );
+    ASSERT( engine->get( to_bytes( "key-1002" ) ).unwrap() ==
+            to_bytes( "new-2" ) );
+
+    // merge 之后快照仍能读到旧数据，其引用的输入文件改名保留
+    ASSERT( engine->merge().is_ok() );
+    auto count_retired = [ & ]() {
+        int count = 0;
+        for ( const auto &entry :
+              filesystem::directory_iterator( options.dir_path ) ) {
+            count += entry.path().extension() == RETIRED_FILE_NAME_SUFFIX;
+        }
+        return count;
+    };
+    ASSERT( count_retired() > 0 );
+
+    int  count = 0;
+    bool match = true;
+    auto res   = snapshot->scan(
+        IteratorOptions(),
+        [ & ]( const vector< u8 > &key, const vector< u8 > &value ) {
+            match = match && value == to_bytes( "old-" + to_string( count ) ) &&
+                    key == to_bytes( "key-" + to_string( 1000 + count ) );
+            count++;
+            return true;
+        } );
+    ASSERT( res.is_ok() );
+    ASSERT_EQ( count, 200 );
+    ASSERT( match );
+
+    // 快照释放后删除退役的文件，重新打开时数据为最新状态
+    snapshot.reset();
+    ASSERT_EQ( count_retired(), 0 );
+    engine.reset();
+    engine = Engine::open( options ).unwrap();
+    ASSERT( engine->get( to_bytes( "key-1001" ) ).unwrap_err() ==
+            Errors::KeyNotFound );
+    ASSERT( engine->get( to_bytes( "key-1002" ) ).unwrap() ==
+            to_bytes( "new-2" ) );
+    ASSERT_EQ( engine->list_keys().size(), 101 );
+
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_ttl() {
+    Options options;
+    options.dir_path            = "../../../../tmp/test_engine_ttl";
+    options.data_file_size      = 4096;
+    options.inline_value_size   = 16;
+    options.ttl_tick_ms         = 10;
+    options.merge_garbage_ratio = 0;
+    filesystem::remove_all( options.dir_path );
+
+    auto engine = Engine::open( options ).unwrap();
+    for ( int i = 0; i < 100; i++ ) {
+        auto key = to_bytes( "session-" + to_string( 1000 + i ) );
+        engine->put( key, to_bytes( "value-" + to_string( i ) ),
+                     i % 2 == 0 ? 100 : 0 );
+    }
+    // 过期之前覆盖为永不过期的数据，回收线程不能删除它
+    engine->put( to_bytes( "session-1000" ), to_bytes( "forever" ) );
+    ASSERT( engine->get( to_bytes( "session-1002" ) ).is_ok() );
+    ASSERT_EQ( engine->list_keys().size(), 100 );
+
+    this_thread::sleep_for( chrono::milliseconds( 300 ) );
+    auto expired = engine->get( to_bytes( "session-1002" ) );
+    ASSERT( expired.is_err() &&
+            expired.unwrap_err() == Errors::KeyNotFound );
+    ASSERT( engine->get( to_bytes( "session-1000" ) ).unwrap() ==
+            to_bytes( "forever" ) );
+    ASSERT( engine->get( to_bytes( "session-1001" ) ).is_ok() );
+    ASSERT_EQ( engine->list_keys().size(), 51 );
+    auto values = engine->multi_get(
+        { to_bytes( "session-1001" ), to_bytes( "session-1004" ) } );
+    ASSERT( values[ 0 ].is_ok() && values[ 1 ].is_err() );
+
+    // merge 丢弃过期的记录，重新打开后仍然不可见
+    ASSERT( engine->merge().is_ok() );
+    engine.reset();
+    engine = Engine::open( options ).unwrap();
+    ASSERT_EQ( engine->list_keys().size(), 51 );
+    ASSERT( engine->get( to_bytes( "session-1098" ) ).is_err() );
+    ASSERT( engine->get( to_bytes( "session-1099" ) ).unwrap() ==
+            to_bytes( "value-99" ) );
+
+    // 从数据文件加载的过期时间同样生效
+    engine->put( to_bytes( "short" ), to_bytes( "lived" ), 50 );
+    engine.reset();
+    engine = Engine::open( options ).unwrap();
+    ASSERT( engine->get( to_bytes( "short" ) ).is_ok() );
+    this_thread::sleep_for( chrono::milliseconds( 200 ) );
+    ASSERT( engine->get( to_bytes( "short" ) ).is_err() );
+
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_read_modify_write() {
+    Options options;
+    options.dir_path          = "../../../../tmp/test_engine_read_modify_write";
+    options.inline_value_size = 8;
+    filesystem::remove_all( options.dir_path );
+
+    auto engine = Engine::open( options ).unwrap();
+    auto key    = to_bytes( "lock" );
+    auto cas    = [ & ]( optional< vector< u8 > > expected, string value ) {
+        return engine->compare_and_swap( key, expected, to_bytes( value ) )
+            .unwrap();
+    };
+    // ASSERT 会对表达式求值两次，先保存每次调用的结果
+    bool created   = cas( nullopt, "a" );
+    bool recreated = cas( nullopt, "b" );
+    bool mismatch  = cas( to_bytes( "b" ), "c" );
+    bool swapped   = cas( to_bytes( "a" ), "c" );
+    ASSERT( created && !recreated && !mismatch && swapped );
+    ASSERT( engine->get( key ).unwrap() == to_bytes( "c" ) );
+
+    // 多个线程并发自增同一个 key，不丢失更新
+    constexpr int THREAD_NUM = 4, INCREMENTS = 500;
+    vector< thread > threads;
+    for ( int t = 0; t < THREAD_NUM; t++ ) {
+        threads.emplace_back( [ & ]() {
+            for ( int i = 0; i < INCREMENTS; i++ ) {
+                engine->increment( to_bytes( "counter" ), 2 );
+            }
+        } );
+    }
+    for ( auto &t : threads ) {
+        t.join();
+    }
+    ASSERT( engine->get( to_bytes( "counter" ) ).unwrap() ==
+            to_bytes( to_string( THREAD_NUM * INCREMENTS * 2 ) ) );
+    auto negative = engine->increment( to_bytes( "counter" ), -4001 );
+    ASSERT_EQ( negative.unwrap(), -1 );
+
+    auto not_integer = engine->increment( key, 1 );
+    ASSERT( not_integer.unwrap_err() == Errors::ValueIsNotInteger );
+    engine->put( to_bytes( "max" ), to_bytes( to_string( INT64_MAX ) ) );
+    auto overflow = engine->increment( to_bytes( "max" ), 1 );
+    ASSERT( overflow.unwrap_err() == Errors::IntegerOverflow );
+
+    // compare_and_swap 与 increment 都保留原有的过期时间
+    engine->put( to_bytes( "lease" ), to_bytes( "owner-a" ), 200 );
+    engine->put( to_bytes( "hits" ), to_bytes( "1" ), 200 );
+    auto renamed = engine->compare_and_swap(
+        to_bytes( "lease" ), to_bytes( "owner-a" ), to_bytes( "owner-b" ) );
+    ASSERT( renamed.unwrap() );
+    auto hits = engine->increment( to_bytes( "hits" ), 1 );
+    ASSERT_EQ( hits.unwrap(), 2 );
+    this_thread::sleep_for( chrono::milliseconds( 500 ) );
+    ASSERT( engine->get( to_bytes( "lease" ) ).is_err() );
+    ASSERT( engine->get( to_bytes( "hits" ) ).is_err() );
 
-    t1.join();
-    t2.join();
+    engine.reset();
+    filesystem::remove_all( options.dir_path );
 }
+
+void test_engine_write_batch() {
+    Options options;
+    options.dir_path            = "../../../../tmp/test_engine_write_batch";
+    options.data_file_size      = 1024;
+    options.merge_garbage_ratio = 0;
+    filesystem::remove_all( options.dir_path );
+
+    // 文件名为补 0 的文件 id，最大的就是活跃文件
+    auto last_data_file = [ & ]() {
+        filesystem::path last;
+        for ( auto &entry :
+              filesystem::directory_iterator( options.dir_path ) ) {
+            if ( entry.path().extension() == DATA_FILE_NAME_SUFFIX &&
+                 entry.path() > last ) {
+                last = entry.path();
+            }
+        }
+        return last;
+    };
+    auto check = [ & ]( Engine &engine ) {
+        for ( int i = 0; i < 10; i++ ) {
+            ASSERT( engine.get( to_bytes( "key-" + to_string( i ) ) )
+                        .unwrap() == to_bytes( "value-4" ) );
+        }
+        ASSERT( engine.get( to_bytes( "old" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        ASSERT_EQ( engine.list_keys().size(), 10 );
+    };
+
+    {
+        auto engine = Engine::open( options ).unwrap();
+        engine->put( to_bytes( "old" ), to_bytes( "old" ) ).unwrap();
+
+        // 提交之前暂存的写入不可见，之后全部生效
+        for ( int round = 0; round < 5; round++ ) {
+            auto batch = engine->new_write_batch();
+            for ( int i = 0; i < 10; i++ ) {
+                batch->put( to_bytes( "key-" + to_string( i ) ),
+                            to_bytes( "value-" + to_string( round ) ) );
+            }
+            if ( round == 4 ) {
+                batch->del( to_bytes( "old" ) ).unwrap();
+                batch->del( to_bytes( "missing" ) ).unwrap();
+            }
+            bool visible = engine->get( to_bytes( "key-0" ) ).is_ok();
+            ASSERT( visible == ( round > 0 ) );
+            ASSERT( batch->commit().is_ok() );
+        }
+        check( *engine );
+
+        // 暂存删除之后才被其他写者创建的 key，提交时同样被删除
+        auto late = engine->new_write_batch();
+        late->del( to_bytes( "late" ) ).unwrap();
+        engine->put( to_bytes( "late" ), to_bytes( "late" ) ).unwrap();
+        ASSERT( late->commit().is_ok() );
+        ASSERT( engine->get( to_bytes( "late" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+
+        // 超过最大数量时拒绝提交
+        WriteBatchOptions batch_options;
+        batch_options.max_batch_num = 2;
+        auto batch                  = engine->new_write_batch( batch_options );
+        for ( int i = 0; i < 3; i++ ) {
+            batch->put( to_bytes( "over-" + to_string( i ) ), {} );
+        }
+        auto res = batch->commit();
+        ASSERT( res.unwrap_err() == Errors::ExceedMaxBatchNum );
+    }
+
+    // 重新打开时提交的批量写入全部恢复，merge 丢弃提交标识
+    {
+        auto engine = Engine::open( options ).unwrap();
+        check( *engine );
+        ASSERT( engine->merge().is_ok() );
+        check( *engine );
+    }
+
+    // 在提交标识写入之前崩溃: 活跃文件尾部只有批量记录，重新打开时整体丢弃
+    auto active_path = last_data_file();
+    u64  synced_size = filesystem::file_size( active_path );
+    {
+        FileIO file_io( active_path.string() );
+        for ( int i = 0; i < 3; i++ ) {
+            LogRecord record{ to_bytes( "torn-" + to_string( i ) ),
+                              to_bytes( "torn" ), LogRecordType::NORMAL };
+            record.seq_no   = 1000 + i;
+            record.in_batch = true;
+            auto enc_record = record.encode();
+            file_io.write( enc_record );
+        }
+    }
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT_EQ( filesystem::file_size( active_path ), synced_size );
+        ASSERT( engine->get( to_bytes( "torn-0" ) ).unwrap_err() ==
+                Errors::KeyNotFound );
+        check( *engine );
+        engine->put( to_bytes( "key-0" ), to_bytes( "value-4" ) ).unwrap();
+    }
+    {
+        auto engine = Engine::open( options ).unwrap();
+        check( *engine );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
+void test_engine_write_batch_merge() {
+    Options options;
+    options.dir_path            = "../../../../tmp/test_write_batch_merge";
+    options.data_file_size      = 4096;
+    options.merge_garbage_ratio = 0;
+    filesystem::remove_all( options.dir_path );
+
+    // merge 拷贝的批量记录没有对应的提交标识，重新打开时不能被当作
+    // 未提交的批量写入截断。批量写入与普通写入交替，merge 的每个输出文件中
+    // 都有批量记录，其中 id 最大的输出文件在重新打开时成为活跃文件
+    auto value = to_bytes( string( 100, 'v' ) );
+    {
+        auto engine = Engine::open( options ).unwrap();
+        for ( int round = 0; round < 5; round++ ) {
+            auto batch = engine->new_write_batch();
+            batch->put( to_bytes( "batch-" + to_string( round ) ), value );
+            ASSERT( batch->commit().is_ok() );
+            for ( int i = 0; i < 20; i++ ) {
+                engine->put( to_bytes( "key-" + to_string( round * 20 + i ) ),
+                             value );
+            }
+        }
+        ASSERT( engine->merge().is_ok() );
+    }
+    {
+        auto engine = Engine::open( options ).unwrap();
+        ASSERT_EQ( engine->list_keys().size(), 105 );
+        ASSERT( engine->get( to_bytes( "batch-0" ) ).unwrap() == value );
+        ASSERT( engine->get( to_bytes( "key-99" ) ).unwrap() == value );
+    }
+
+    filesystem::remove_all( options.dir_path );
+}
+
 void test() {
-    // test_btree_put();
+    test_btree_put();
     // test_btree_get();
     // test_btree_del();
     // test_btree_mutilthread_put();
@@ -258,4 +2048,33 @@ void test() {
     // test_file_read_and_write();
     // test_string_view();
     test_RwLock();
+    test_btree_iterator();
+    test_timer_wheel();
+    test_seq_lock();
+
+    test_data_file_write_and_read();
+    test_engine_put_get_del();
+    test_engine_concurrent_get();
+    test_engine_concurrent_put();
+    test_engine_multi_active_files();
+    test_partitioned_engine();
+    test_engine_merge();
+    test_engine_selective_merge();
+    test_engine_merge_active_file();
+    test_engine_parallel_merge();
+    test_engine_hint_file();
+    test_engine_parallel_load();
+    test_engine_checkpoint();
+    test_engine_checkpoint_merge();
+    test_engine_lazy_index_load();
+    test_engine_crash_recovery();
+    test_engine_value_cache();
+    test_engine_inline_value();
+    test_engine_multi_get();
+    test_engine_scan();
+    test_engine_snapshot();
+    test_engine_ttl();
+    test_engine_read_modify_write();
+    test_engine_write_batch();
+    test_engine_write_batch_merge();
 }
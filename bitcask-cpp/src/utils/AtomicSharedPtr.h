@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace bitcask {
+
+/// @brief 可以被多个线程并发 load/store 的 shared_ptr
+/// 临界区只有一次引用计数的增减，用自旋锁保护。
+/// libstdc++ 12 的 atomic<shared_ptr> 在 load 之后以 relaxed 解锁，
+/// 与并发的 store 之间没有 happens-before 关系，因此这里自行实现。
+template < typename T > class AtomicSharedPtr {
+  public:
+    AtomicSharedPtr() = default;
+    AtomicSharedPtr( std::shared_ptr< T > ptr )
+        : m_ptr( std::move( ptr ) ) {
+    }
+    AtomicSharedPtr( const AtomicSharedPtr & )            = delete;
+    AtomicSharedPtr &operator=( const AtomicSharedPtr & ) = delete;
+
+    std::shared_ptr< T > load() const {
+        lock();
+        std::shared_ptr< T > ptr = m_ptr;
+        unlock();
+        return ptr;
+    }
+
+    void store( std::shared_ptr< T > ptr ) {
+        lock();
+        m_ptr.swap( ptr );
+        unlock();
+        // 旧对象在锁外释放
+    }
+
+  private:
+    void lock() const {
+        while ( m_lock.test_and_set( std::memory_order_acquire ) ) {
+            while ( m_lock.test( std::memory_order_relaxed ) ) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    void unlock() const {
+        m_lock.clear( std::memory_order_release );
+    }
+
+    mutable std::atomic_flag m_lock = ATOMIC_FLAG_INIT;
+    std::shared_ptr< T >     m_ptr;
+};
+
+} // namespace bitcask
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "type.h"
+#include <algorithm>
 #include <vector>
 
 using namespace std;
@@ -16,9 +17,37 @@ class IOManager {
     IOManager &operator=( IOManager && )      = default;
     virtual ~IOManager()                      = default;
 
-    virtual u64  read( vector< u8 > &buf, u64 offset ) = 0;
-    virtual u64  write( vector< u8 > &buf )            = 0;
-    virtual void sync()                                = 0;
+    virtual u64  read( vector< u8 > &buf, u64 offset )     = 0;
+    virtual u64  write( vector< u8 > &buf )                = 0;
+    // 在指定位置写入数据，可以被多个线程并发调用。写入的末尾超过追加写的位置时
+    // 将其推进到末尾，之后的 write 不会覆盖已经写入的区域
+    virtual u64  write_at( vector< u8 > &buf, u64 offset ) = 0;
+    virtual void sync()                                    = 0;
+    // 截断到指定长度，只在没有并发读写时调用
+    virtual void truncate( u64 size )                      = 0;
+    // 文件的长度，包括已经写入但尚未持久化的数据
+    virtual u64  size() const                              = 0;
+
+    // 将 src 中 [src_offset, src_offset + len) 的数据写入 dst_offset，
+    // 返回拷贝的字节数。zero_copy 为 true 时实现可以直接在内核中拷贝，
+    // 默认经过用户态缓冲区
+    virtual u64 copy_from( IOManager &src, u64 src_offset, u64 len,
+                           u64 dst_offset, bool zero_copy ) {
+        ( void )zero_copy;
+        vector< u8 > buf;
+        u64          copied = 0;
+        while ( copied < len ) {
+            buf.resize( min< u64 >( len - copied, 1024 * 1024 ) );
+            u64 n = src.read( buf, src_offset + copied );
+            if ( n == 0 ) {
+                break;
+            }
+            buf.resize( n );
+            write_at( buf, dst_offset + copied );
+            copied += n;
+        }
+        return copied;
+    }
 };
 
 } // namespace bitcask
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "type.h"
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace bitcask {
+
+/// @brief 按字节数限速，多个线程共享同一个限速器时总速率不超过 bytes_per_sec
+/// 每次 acquire 预约一段时间窗口，调用方在窗口开始之前睡眠。
+class RateLimiter {
+  public:
+    // bytes_per_sec 为 0 表示不限速
+    explicit RateLimiter( u64 bytes_per_sec )
+        : m_bytes_per_sec( bytes_per_sec )
+        , m_next_free( std::chrono::steady_clock::now() ) {
+    }
+
+    void acquire( u64 bytes ) {
+        if ( m_bytes_per_sec == 0 || bytes == 0 ) {
+            return;
+        }
+
+        std::chrono::steady_clock::time_point wait_until;
+        {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            auto now = std::chrono::steady_clock::now();
+            if ( m_next_free < now ) {
+                m_next_free = now;
+            }
+            wait_until = m_next_free;
+            m_next_free += std::chrono::nanoseconds(
+                bytes * 1000000000ull / m_bytes_per_sec );
+        }
+        std::this_thread::sleep_until( wait_until );
+    }
+
+  private:
+    u64                                   m_bytes_per_sec;
+    std::mutex                            m_mutex;
+    std::chrono::steady_clock::time_point m_next_free;
+};
+
+} // namespace bitcask
@@ -1,10 +1,211 @@
 #pragma once
 
+#include "type.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <shared_mutex>
 #include <thread>
+#include <vector>
 namespace bitcask {
 
+/// @brief 读多写少场景下可扩展的读写锁，参考 BRAVO (Biased Locking for
+/// Reader-Writer Locks)。
+/// 读偏置开启时，读者只修改按线程分配的读者指示器 (每个占一个缓存行，数量与核数
+/// 相当)，不同核上的读者不会争用同一个缓存行; 写者关闭读偏置，等待所有指示器
+/// 归零，再通过底层的 std::shared_mutex 与其他读者写者互斥。
+/// 写者撤销偏置的开销较大，撤销之后的一段时间 (撤销耗时的 INHIBIT_MULTIPLIER 倍，
+/// 至少 MIN_INHIBIT_NS) 内读者走底层读写锁，写多的场景下自动退化为 std::shared_mutex。
+/// prefer_writer 为 true 时，有写者等待期间新的读者既不走读偏置也不进入底层读写锁，
+/// 写者不会被持续到来的读者饿死。
+/// 满足 SharedMutex 的要求，可以配合 std::unique_lock 与 std::shared_lock 使用。
+class ScalableSharedMutex {
+  public:
+    explicit ScalableSharedMutex( bool prefer_writer = false )
+        : m_prefer_writer( prefer_writer )
+        , m_indicator_mask( indicator_num() - 1 )
+        , m_indicators( new Indicator[ indicator_num() ] ) {
+    }
+
+    ScalableSharedMutex( const ScalableSharedMutex & )            = delete;
+    ScalableSharedMutex &operator=( const ScalableSharedMutex & ) = delete;
+
+    void lock_shared() {
+        if ( lock_shared_fast() ) {
+            return;
+        }
+
+        if ( m_prefer_writer ) {
+            while ( writer_waiting() ) {
+                std::this_thread::yield();
+            }
+        }
+        m_mutex.lock_shared();
+        // 撤销偏置的抑制期已过，重新开启读偏置。读取时钟的开销与加锁相当，
+        // 每个线程每 INHIBIT_CHECK_INTERVAL 次慢速加锁检查一次
+        thread_local u64 slow_reads = 0;
+        if ( ++slow_reads % INHIBIT_CHECK_INTERVAL == 0 &&
+             !m_read_bias.load( std::memory_order_relaxed ) &&
+             now_ns() >= m_inhibit_until.load( std::memory_order_relaxed ) ) {
+            m_read_bias.store( true );
+        }
+    }
+
+    bool try_lock_shared() {
+        if ( lock_shared_fast() ) {
+            return true;
+        }
+        if ( writer_waiting() ) {
+            return false;
+        }
+        return m_mutex.try_lock_shared();
+    }
+
+    void unlock_shared() {
+        auto &held = fast_readers();
+        auto  iter = std::find( held.begin(), held.end(), this );
+        if ( iter == held.end() ) {
+            m_mutex.unlock_shared();
+            return;
+        }
+        held.erase( iter );
+        indicator().readers.fetch_sub( 1, std::memory_order_release );
+    }
+
+    void lock() {
+        if ( m_prefer_writer ) {
+            m_waiting_writers.fetch_add( 1, std::memory_order_acq_rel );
+            m_mutex.lock();
+            m_waiting_writers.fetch_sub( 1, std::memory_order_acq_rel );
+        } else {
+            m_mutex.lock();
+        }
+
+        if ( m_read_bias.load( std::memory_order_relaxed ) ) {
+            m_read_bias.store( false );
+            u64 start = now_ns();
+            for ( u64 i = 0; i <= m_indicator_mask; i++ ) {
+                while ( m_indicators[ i ].readers.load() > 0 ) {
+                    std::this_thread::yield();
+                }
+            }
+            inhibit_bias( start );
+        }
+    }
+
+    bool try_lock() {
+        if ( !m_mutex.try_lock() ) {
+            return false;
+        }
+        if ( !m_read_bias.load( std::memory_order_relaxed ) ) {
+            return true;
+        }
+
+        // 关闭偏置后只检查一次指示器，仍有读者时恢复偏置。
+        // 持有底层写锁期间其他线程不会修改偏置
+        m_read_bias.store( false );
+        u64 start = now_ns();
+        for ( u64 i = 0; i <= m_indicator_mask; i++ ) {
+            if ( m_indicators[ i ].readers.load() > 0 ) {
+                m_read_bias.store( true );
+                m_mutex.unlock();
+                return false;
+            }
+        }
+        inhibit_bias( start );
+        return true;
+    }
+
+    void unlock() {
+        m_mutex.unlock();
+    }
+
+  private:
+    // 撤销偏置之后禁止重新开启偏置的时长与撤销耗时的倍数
+    static constexpr u64 INHIBIT_MULTIPLIER = 9;
+
+    // 禁止重新开启偏置的最短时长，核数较少时撤销很快，避免写多时频繁切换
+    static constexpr u64 MIN_INHIBIT_NS = 100 * 1000;
+
+    // 慢速加锁检查抑制期是否结束的间隔
+    static constexpr u64 INHIBIT_CHECK_INTERVAL = 16;
+
+    // 读者指示器数量的上限
+    static constexpr u64 MAX_INDICATOR_NUM = 64;
+
+    struct alignas( 64 ) Indicator {
+        std::atomic< u64 > readers = 0;
+    };
+
+    // 不小于核数的 2 的幂
+    static u64 indicator_num() {
+        static const u64 num = std::bit_ceil( std::clamp< u64 >(
+            std::thread::hardware_concurrency(), 1, MAX_INDICATOR_NUM ) );
+        return num;
+    }
+
+    // 读偏置开启时只登记读者指示器。prefer_writer 时有写者等待则不走快速路径，
+    // 否则写者拿到底层写锁之前新的读者仍然可以不断进入
+    bool lock_shared_fast() {
+        if ( !m_read_bias.load( std::memory_order_acquire ) ||
+             writer_waiting() ) {
+            return false;
+        }
+        auto &readers = indicator().readers;
+        // 先登记再确认偏置仍然有效，与写者先关闭偏置再检查指示器对应
+        readers.fetch_add( 1 );
+        if ( m_read_bias.load() ) {
+            fast_readers().push_back( this );
+            return true;
+        }
+        readers.fetch_sub( 1, std::memory_order_release );
+        return false;
+    }
+
+    bool writer_waiting() const {
+        return m_prefer_writer &&
+               m_waiting_writers.load( std::memory_order_acquire ) > 0;
+    }
+
+    // 撤销偏置之后，在撤销耗时的 INHIBIT_MULTIPLIER 倍时间内不再开启偏置
+    void inhibit_bias( u64 start ) {
+        u64 end     = now_ns();
+        u64 inhibit = std::max( ( end - start ) * INHIBIT_MULTIPLIER,
+                                MIN_INHIBIT_NS );
+        m_inhibit_until.store( end + inhibit, std::memory_order_relaxed );
+    }
+
+    // 当前线程通过读者指示器持有的锁，解锁时据此区分两种加锁方式
+    static std::vector< const ScalableSharedMutex * > &fast_readers() {
+        thread_local std::vector< const ScalableSharedMutex * > held;
+        return held;
+    }
+
+    // 线程按创建顺序轮流分配指示器
+    Indicator &indicator() const {
+        static std::atomic< u64 > next_thread_id = 0;
+        thread_local u64          thread_id = next_thread_id.fetch_add( 1 );
+        return m_indicators[ thread_id & m_indicator_mask ];
+    }
+
+    static u64 now_ns() {
+        return std::chrono::duration_cast< std::chrono::nanoseconds >(
+                   std::chrono::steady_clock::now().time_since_epoch() )
+            .count();
+    }
+
+    bool                           m_prefer_writer;
+    u64                            m_indicator_mask;
+    std::unique_ptr< Indicator[] > m_indicators;
+    std::atomic< bool >            m_read_bias       = true;
+    std::atomic< u64 >             m_inhibit_until   = 0;
+    std::atomic< u64 >             m_waiting_writers = 0;
+    std::shared_mutex              m_mutex;
+};
+
 template < class T > class WriteGuard;
 template < class T > class ReadGuard;
 
@@ -25,13 +226,13 @@ template < typename T > class RwLock {
     }
 
   private:
-    std::shared_mutex mutex;
-    T                 m_data;
+    ScalableSharedMutex mutex;
+    T                   m_data;
 };
 
 template < class T > class ReadGuard {
   public:
-    ReadGuard( T &data, std::shared_mutex &mutex )
+    ReadGuard( T &data, ScalableSharedMutex &mutex )
         : m_data( data )
         , m_mutex( mutex ) {
         lock();
@@ -51,13 +252,13 @@ template < class T > class ReadGuard {
     }
 
   private:
-    T                 &m_data;
-    std::shared_mutex &m_mutex;
+    T                   &m_data;
+    ScalableSharedMutex &m_mutex;
 };
 
 template < class T > class WriteGuard {
   public:
-    WriteGuard( T &data, std::shared_mutex &mutex )
+    WriteGuard( T &data, ScalableSharedMutex &mutex )
         : m_data( data )
         , m_mutex( mutex ) {
         lock();
@@ -65,19 +266,20 @@ template < class T > class WriteGuard {
     ~WriteGuard() {
         unlock();
     }
+    // 写者独占
     void lock() {
-        m_mutex.lock_shared();
+        m_mutex.lock();
     }
     void unlock() {
-        m_mutex.unlock_shared();
+        m_mutex.unlock();
     }
     T &data() {
         return m_data;
     }
 
   private:
-    T                 &m_data;
-    std::shared_mutex &m_mutex;
+    T                   &m_data;
+    ScalableSharedMutex &m_mutex;
 };
 
-} // namespace bitcask
\ No newline at end of file
+} // namespace bitcask
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "type.h"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace bitcask {
+
+/// @brief 顺序锁保护的一小块数据，读多写少且读者需要一致的多个字段时使用。
+/// 读者乐观地拷贝数据，序号在拷贝前后不一致 (或为奇数，写者正在修改) 时重试，
+/// 读者不写任何共享的缓存行; 写者把序号改为奇数、写入数据、再改回偶数，
+/// 多个写者之间通过序号的 CAS 互斥。
+/// 数据按字保存在原子变量中，并发的读写不构成数据竞争，T 必须可平凡拷贝。
+template < typename T > class SeqLock {
+    static_assert( std::is_trivially_copyable_v< T > );
+
+  public:
+    SeqLock() {
+        store_words( T{} );
+    }
+    explicit SeqLock( const T &value ) {
+        store_words( value );
+    }
+    SeqLock( const SeqLock & )            = delete;
+    SeqLock &operator=( const SeqLock & ) = delete;
+
+    T load() const {
+        while ( true ) {
+            u64 seq = m_seq.load( std::memory_order_acquire );
+            if ( seq & 1 ) {
+                std::this_thread::yield();
+                continue;
+            }
+            T value = load_words();
+            std::atomic_thread_fence( std::memory_order_acquire );
+            if ( m_seq.load( std::memory_order_relaxed ) == seq ) {
+                return value;
+            }
+        }
+    }
+
+    void store( const T &value ) {
+        update( [ & ]( T &current ) { current = value; } );
+    }
+
+    // 在写锁内读取、修改数据
+    template < typename F > void update( F &&fn ) {
+        u64 seq = m_seq.load( std::memory_order_relaxed );
+        while ( ( seq & 1 ) ||
+                !m_seq.compare_exchange_weak( seq, seq + 1,
+                                              std::memory_order_acquire ) ) {
+            std::this_thread::yield();
+            seq = m_seq.load( std::memory_order_relaxed );
+        }
+        // 序号变为奇数之后才能写入数据
+        std::atomic_thread_fence( std::memory_order_release );
+        T value = load_words();
+        fn( value );
+        store_words( value );
+        m_seq.store( seq + 2, std::memory_order_release );
+    }
+
+  private:
+    static constexpr u64 WORD_NUM = ( sizeof( T ) + 7 ) / 8;
+
+    T load_words() const {
+        std::array< u64, WORD_NUM > words;
+        for ( u64 i = 0; i < WORD_NUM; i++ ) {
+            words[ i ] = m_words[ i ].load( std::memory_order_relaxed );
+        }
+        // T 不一定可平凡默认构造，经过字节数组转换而不是 memcpy 到 T 中
+        std::array< unsigned char, sizeof( T ) > bytes;
+        std::memcpy( bytes.data(), words.data(), sizeof( T ) );
+        return std::bit_cast< T >( bytes );
+    }
+
+    void store_words( const T &value ) {
+        std::array< u64, WORD_NUM > words{};
+        std::memcpy( words.data(), &value, sizeof( T ) );
+        for ( u64 i = 0; i < WORD_NUM; i++ ) {
+            m_words[ i ].store( words[ i ], std::memory_order_relaxed );
+        }
+    }
+
+    std::atomic< u64 >                         m_seq = 0;
+    std::array< std::atomic< u64 >, WORD_NUM > m_words;
+};
+
+} // namespace bitcask
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "type.h"
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+namespace bitcask {
+
+/// @brief 分层时间轮，按 tick 管理大量定时项，添加和推进的均摊开销都是 O(1)。
+/// 第 l 层的每个槽位覆盖 64^l 个 tick，推进到低层转完一圈时把上一层对应槽位中的
+/// 定时项重新分配到更低的层，超出最高层范围的定时项放在溢出列表中等待。
+/// 不是线程安全的，由调用方加锁。
+template < typename T > class TimerWheel {
+  public:
+    // current_tick 之前 (含) 的定时项在下一次 advance 时立即到期
+    explicit TimerWheel( u64 current_tick )
+        : m_current( current_tick ) {
+    }
+
+    // 添加一个在 tick 到期的定时项
+    void add( u64 tick, T item ) {
+        m_size++;
+        place( Timer{ tick, std::move( item ) } );
+    }
+
+    // 推进到 now_tick，把到期的定时项追加到 expired 中
+    void advance( u64 now_tick, std::vector< T > &expired ) {
+        // 没有定时项时直接跳到 now_tick，长时间空闲之后不需要逐个 tick 推进
+        if ( m_size == m_ready.size() && m_current < now_tick ) {
+            m_current = now_tick;
+        }
+        while ( m_current < now_tick ) {
+            m_current++;
+            cascade();
+            drain( m_wheels[ 0 ][ m_current & SLOT_MASK ], expired );
+        }
+        // 添加时已经到期以及重新分配时恰好到期的定时项
+        drain( m_ready, expired );
+    }
+
+    // 尚未到期的定时项数量
+    u64 size() const {
+        return m_size;
+    }
+
+  private:
+    static constexpr u64 SLOT_BITS = 6;
+    static constexpr u64 SLOT_NUM  = 1 << SLOT_BITS;
+    static constexpr u64 SLOT_MASK = SLOT_NUM - 1;
+    static constexpr u64 LEVEL_NUM = 4;
+
+    struct Timer {
+        u64 tick;
+        T   item;
+    };
+
+    // tick 在第 level 层的槽位
+    static u64 digit( u64 tick, u64 level ) {
+        return ( tick >> ( SLOT_BITS * level ) ) & SLOT_MASK;
+    }
+
+    // 选择 tick 与当前时间的高位相同的最低一层，槽位由 tick 在该层的位决定
+    void place( Timer timer ) {
+        if ( timer.tick <= m_current ) {
+            m_ready.push_back( std::move( timer ) );
+            return;
+        }
+        for ( u64 level = 0; level < LEVEL_NUM; level++ ) {
+            u64 shift = SLOT_BITS * ( level + 1 );
+            if ( ( timer.tick >> shift ) == ( m_current >> shift ) ) {
+                u64 slot = digit( timer.tick, level );
+                m_wheels[ level ][ slot ].push_back( std::move( timer ) );
+                return;
+            }
+        }
+        m_overflow.push_back( std::move( timer ) );
+    }
+
+    // 低层转完一圈时，把上一层当前槽位中的定时项重新分配，从最高层开始
+    void cascade() {
+        u64 level = 0;
+        while ( level < LEVEL_NUM && digit( m_current, level ) == 0 ) {
+            level++;
+        }
+        if ( level == LEVEL_NUM ) {
+            redistribute( m_overflow );
+        }
+        for ( u64 l = std::min( level, LEVEL_NUM - 1 ); l >= 1; l-- ) {
+            redistribute( m_wheels[ l ][ digit( m_current, l ) ] );
+        }
+    }
+
+    void drain( std::vector< Timer > &timers, std::vector< T > &expired ) {
+        for ( auto &timer : timers ) {
+            expired.push_back( std::move( timer.item ) );
+        }
+        m_size -= timers.size();
+        timers.clear();
+    }
+
+    void redistribute( std::vector< Timer > &timers ) {
+        std::vector< Timer > moving;
+        moving.swap( timers );
+        for ( auto &timer : moving ) {
+            place( std::move( timer ) );
+        }
+    }
+
+    using Slots = std::array< std::vector< Timer >, SLOT_NUM >;
+
+    u64                            m_current;
+    u64                            m_size = 0;
+    std::array< Slots, LEVEL_NUM > m_wheels;
+    std::vector< Timer >           m_overflow;
+    std::vector< Timer >           m_ready;
+};
+
+} // namespace bitcask
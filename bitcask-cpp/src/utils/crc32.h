@@ -0,0 +1,39 @@
+#pragma once
+
+#include "type.h"
+#include <array>
+#include <cstddef>
+
+namespace bitcask {
+
+// CRC32 (IEEE 802.3) 校验，用于校验 LogRecord 的完整性
+namespace crc32_detail {
+constexpr std::array< u32, 256 > make_table() {
+    std::array< u32, 256 > table{};
+    for ( u32 i = 0; i < 256; i++ ) {
+        u32 c = i;
+        for ( int k = 0; k < 8; k++ ) {
+            c = ( c & 1 ) ? ( 0xEDB88320u ^ ( c >> 1 ) ) : ( c >> 1 );
+        }
+        table[ i ] = c;
+    }
+    return table;
+}
+
+inline constexpr std::array< u32, 256 > table = make_table();
+} // namespace crc32_detail
+
+// 在已有的 crc 基础上继续计算，便于分段计算 header 和 key/value
+inline u32 crc32_update( u32 crc, const u8 *data, std::size_t len ) {
+    crc = ~crc;
+    for ( std::size_t i = 0; i < len; i++ ) {
+        crc = crc32_detail::table[ ( crc ^ data[ i ] ) & 0xFF ] ^ ( crc >> 8 );
+    }
+    return ~crc;
+}
+
+inline u32 crc32( const u8 *data, std::size_t len ) {
+    return crc32_update( 0, data, len );
+}
+
+} // namespace bitcask
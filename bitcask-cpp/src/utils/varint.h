@@ -0,0 +1,36 @@
+#pragma once
+
+#include "type.h"
+#include <cstddef>
+#include <vector>
+
+namespace bitcask {
+
+// varint 最多占用的字节数
+constexpr std::size_t MAX_VARINT32_LEN = 5;
+constexpr std::size_t MAX_VARINT64_LEN = 10;
+
+// 以 varint 的形式将 value 追加到 buf 末尾
+inline void put_varint( std::vector< u8 > &buf, u64 value ) {
+    while ( value >= 0x80 ) {
+        buf.push_back( static_cast< u8 >( value ) | 0x80 );
+        value >>= 7;
+    }
+    buf.push_back( static_cast< u8 >( value ) );
+}
+
+// 从 data[0, len) 中解析 varint，成功返回占用的字节数，失败返回 0
+inline std::size_t get_varint( const u8 *data, std::size_t len, u64 &value ) {
+    value     = 0;
+    u32 shift = 0;
+    for ( std::size_t i = 0; i < len && i < MAX_VARINT64_LEN; i++ ) {
+        value |= static_cast< u64 >( data[ i ] & 0x7F ) << shift;
+        if ( ( data[ i ] & 0x80 ) == 0 ) {
+            return i + 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+} // namespace bitcask